@@ -1,34 +1,44 @@
-/* compile the code with -O3 */
+/* compile the code with gcc -O3 -fopenmp hw1_exponent.c -lm -o hw */
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <sys/time.h>
 #include <time.h>
+#include <stdint.h>
+#include "../common/bench_harness.h"
+#include "../common/parallel_reduce.h"
 
-static double timer() 
-{
+/* modulus for the exact result, prime */
+#define MODULUS 1000000007
+
+#define mulmod(a, b) PREDUCE_MULMOD(a, b, MODULUS)
+PARALLEL_REDUCE_DEFINE(prod_mod, int, uint64_t, 1, mulmod)
 
-	struct timeval tp;
-	gettimeofday(&tp, NULL);
-	return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-	/* The code below is for another high resolution timer */
-	/* I'm using gettimeofday because it's more portable */
-	/*
-	   struct timespec tp;
-	   clock_gettime(CLOCK_MONOTONIC, &tp);
-	   return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-	   */
+/* x^n modulo m by repeated squaring (m = 0: modulo 2^64) */
+static uint64_t power(uint64_t x, long n, uint64_t m)
+{
+	uint64_t result = 1;
+	while (n > 0)
+	{
+		if (n & 1)
+			result = m ? PREDUCE_MULMOD(result, x, m) : result * x;
+		x = m ? PREDUCE_MULMOD(x, x, m) : x * x;
+		n >>= 1;
+	}
+	return result;
 }
 
 
 int main(int argc, char **argv) 
 {
 
+	bench_harness_args(&argc, argv);
+
 	/* One input argument, value of n */
 	if (argc != 4) {
 		fprintf(stderr, "%s <n> <x> <t>\n", argv[0]);
+		fprintf(stderr, "--bind=compact|scatter|core pins the default OpenMP team, not nested teams (see common/bench_topo.h)\n");
 		exit(1);
 	}
 
@@ -53,24 +63,47 @@ int main(int argc, char **argv)
 		A[i] = x;
 	}
 
-	int total = 1;
-	double elt = timer();
-	#pragma omp parallel for private(i) reduction(*:total)
-	for(i=0; i<n; i++)
+	/* an int total (the old reduction(*:total)) overflows once x^n passes
+	   2^31, so multiply modulo 2^64 and modulo a prime instead */
+	uint64_t total = 1, total_mod = 1;
+	bench_t b;
+	bench_init(&b, "exponent", 1);
+	bench_set_work(&b, 4.0*n, (double) n);
+	while (bench_next(&b))
 	{
-		total = total * A[i];
+		bench_start(&b);
+		total = preduce_prod_i32(A, n);
+		bench_stop(&b);
+	}
+	double elt = bench_stats(&b).median;
+	bench_report(&b);
+	bench_destroy(&b);
+
+	bench_init(&b, "exponent_mod", 1);
+	bench_set_work(&b, 4.0*n, (double) n);
+	while (bench_next(&b))
+	{
+		bench_start(&b);
+		total_mod = prod_mod(A, n);
+		bench_stop(&b);
 	}
 
 	//---------------------------------------------- OLD code start
 
-	elt = timer() - elt;
+	if (total != power(x, n, 0) || total_mod != power(x, n, MODULUS)) {
+		fprintf(stderr, "ERROR: product doesn't match x^n\n");
+		exit(2);
+	}
 
-	fprintf(stderr, "exponent:%d\n", total);
+	fprintf(stderr, "exponent mod 2^64: %llu\n", (unsigned long long) total);
+	fprintf(stderr, "exponent mod %d: %llu\n", MODULUS, (unsigned long long) total_mod);
 	fprintf(stderr, "Elapsed time: %9.6lf s\n", elt);
 	// (num_threads*flops_per_thread)/time_taken_in_seconds
 	long double flops = ((n/t)/1e9/elt)*6;
 
 	fprintf(stderr, "GFlops rate: %11.6Lf GFlops\n", flops);
+	bench_report(&b);
+	bench_destroy(&b);
 
 	return 0;
 }
@@ -0,0 +1,330 @@
+/* Parallel numerical integration, generalizing the midpoint loop of
+ * stockwell_hw1_pi_omp.c to any integrand.
+ *
+ * INTEGRATE_DEFINE(NAME, F) defines, for an integrand F(x) (a macro or a
+ * static inline function of a double, so it is inlined into the loops):
+ *
+ * NAME_midpoint(a, b, n, accum)          n intervals, n evaluations
+ * NAME_simpson(a, b, n, accum)           n intervals, 2n+1 evaluations
+ * NAME_gauss(a, b, n, order, accum)      n intervals, Gauss-Legendre with
+ *                                        order (1 to INTEGRATE_GAUSS_MAX)
+ *                                        points each
+ *   The evaluation points are split into one contiguous block per thread
+ *   (Gauss-Legendre makes one pass per node).
+ *   A thread evaluates INTEGRATE_BATCH points at a time into a buffer with
+ *   an omp simd loop (weight times F, no dependencies between points), then
+ *   adds the buffer up with accum:
+ *     INTEGRATE_PLAIN     one running sum (vectorized, so in lanes)
+ *     INTEGRATE_KAHAN     compensated sums in INTEGRATE_LANES lanes
+ *     INTEGRATE_PAIRWISE  pairwise halving of each batch, and the batch sums
+ *                         combined pairwise through a binary counter, so
+ *                         the error grows with log of the points
+ *   The per-thread sums are padded to a cache line and combined in thread
+ *   order with compensation, so a given thread count always gives the same
+ *   result.
+ *
+ * NAME_adaptive(a, b, eps)
+ *   adaptive Simpson to an absolute error of about eps.  Intervals where
+ *   the two half-interval estimates disagree are split again; the first
+ *   INTEGRATE_TASK_LEVELS levels of the recursion run their left halves as
+ *   OpenMP tasks, so the difficult parts of the interval spread over the
+ *   threads while the deep levels stay cheap recursive calls.
+ *
+ * NAME_integrate(rule, a, b, n, accum) picks the rule by INTEGRATE_MIDPOINT,
+ * INTEGRATE_SIMPSON, INTEGRATE_GAUSS (INTEGRATE_GAUSS_ORDER points) or
+ * INTEGRATE_ADAPTIVE (eps = 1/n).
+ *
+ *   static inline double f(double x) { return 4.0/(1.0+x*x); }
+ *   INTEGRATE_DEFINE(pi, f)
+ *   double approx_pi = pi_simpson(0.0, 1.0, n, INTEGRATE_KAHAN);
+ */
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+enum { INTEGRATE_MIDPOINT, INTEGRATE_SIMPSON, INTEGRATE_GAUSS, INTEGRATE_ADAPTIVE, INTEGRATE_NUM_RULES };
+
+static const char *integrate_rule_names[INTEGRATE_NUM_RULES] = {
+	"midpoint", "simpson", "gauss", "adaptive"
+};
+
+enum { INTEGRATE_PLAIN, INTEGRATE_KAHAN, INTEGRATE_PAIRWISE, INTEGRATE_NUM_ACCUMS };
+
+static const char *integrate_accum_names[INTEGRATE_NUM_ACCUMS] = {
+	"plain", "kahan", "pairwise"
+};
+
+/* points evaluated per batch, a power of two */
+#define INTEGRATE_BATCH 256
+
+/* independent compensated sums per thread, one AVX-512 vector of doubles */
+#define INTEGRATE_LANES 8
+
+/* one partial per cache line so the threads don't false-share */
+#define INTEGRATE_PAD 64
+
+/* recursion levels of the adaptive rule that spawn tasks */
+#define INTEGRATE_TASK_LEVELS 10
+
+/* the adaptive rule gives up refining below this depth */
+#define INTEGRATE_MAX_DEPTH 50
+
+#define INTEGRATE_GAUSS_MAX 5
+#define INTEGRATE_GAUSS_ORDER 4
+
+/* Gauss-Legendre nodes and weights on [-1, 1], row order-1 */
+static const double integrate_gauss_x[INTEGRATE_GAUSS_MAX][INTEGRATE_GAUSS_MAX] = {
+	{ 0.0 },
+	{ -0.5773502691896257645, 0.5773502691896257645 },
+	{ -0.7745966692414833770, 0.0, 0.7745966692414833770 },
+	{ -0.8611363115940525752, -0.3399810435848562648,
+	   0.3399810435848562648,  0.8611363115940525752 },
+	{ -0.9061798459386639928, -0.5384693101056830910, 0.0,
+	   0.5384693101056830910,  0.9061798459386639928 }
+};
+
+static const double integrate_gauss_w[INTEGRATE_GAUSS_MAX][INTEGRATE_GAUSS_MAX] = {
+	{ 2.0 },
+	{ 1.0, 1.0 },
+	{ 0.5555555555555555556, 0.8888888888888888889, 0.5555555555555555556 },
+	{ 0.3478548451374538574, 0.6521451548625461426,
+	  0.6521451548625461426, 0.3478548451374538574 },
+	{ 0.2369268850561890875, 0.4786286704993664680, 0.5688888888888888889,
+	  0.4786286704993664680, 0.2369268850561890875 }
+};
+
+static inline void integrate_team(int *tid, int *nthreads)
+{
+#ifdef _OPENMP
+	*tid = omp_get_thread_num();
+	*nthreads = omp_get_num_threads();
+#else
+	*tid = 0;
+	*nthreads = 1;
+#endif
+}
+
+static inline int integrate_max_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/* adds x to the compensated sum (s, c), Neumaier's variant of Kahan */
+static inline void integrate_kahan_add(double *s, double *c, double x)
+{
+	double t = *s + x;
+	if (fabs(*s) >= fabs(x))
+		*c += (*s - t) + x;
+	else
+		*c += (x - t) + *s;
+	*s = t;
+}
+
+/* sum of buf[0..INTEGRATE_BATCH) by halving, destroys buf */
+static inline double integrate_pairwise_batch(double *buf)
+{
+	int len, i;
+	for (len=INTEGRATE_BATCH/2; len>0; len/=2) {
+		#pragma omp simd
+		for (i=0; i<len; i++)
+			buf[i] += buf[i+len];
+	}
+	return buf[0];
+}
+
+/* Sums VALUE(j) for j in [0, NPTS) over the threads with accumulation mode
+   ACCUM into RESULT.  VALUE is an expression in j and the caller's locals. */
+#define INTEGRATE_SUM_(NPTS, VALUE, ACCUM, RESULT) do { \
+	long integ_npts_ = (NPTS); \
+	int integ_accum_ = (ACCUM); \
+	int integ_max_ = integrate_max_threads(); \
+	double *integ_partials_ = NULL; \
+	if (posix_memalign((void **) &integ_partials_, INTEGRATE_PAD, \
+	                   (size_t) integ_max_ * INTEGRATE_PAD) != 0) { \
+		fprintf(stderr, "integrate: out of memory\n"); \
+		exit(1); \
+	} \
+	int integ_team_ = 1; \
+\
+	_Pragma("omp parallel") \
+	{ \
+		int integ_tid_, integ_nt_; \
+		integrate_team(&integ_tid_, &integ_nt_); \
+		if (integ_tid_ == 0) \
+			integ_team_ = integ_nt_; \
+		long integ_lo_ = integ_npts_*integ_tid_/integ_nt_; \
+		long integ_hi_ = integ_npts_*(integ_tid_+1)/integ_nt_; \
+		double integ_buf_[INTEGRATE_BATCH] __attribute__((aligned(64))); \
+		double integ_s_[INTEGRATE_LANES] = { 0 }, integ_c_[INTEGRATE_LANES] = { 0 }; \
+		double integ_stack_[64]; \
+		long integ_batches_ = 0; \
+		double integ_plain_ = 0; \
+		long integ_start_; \
+		int integ_k_; \
+		for (integ_start_=integ_lo_; integ_start_<integ_hi_; integ_start_+=INTEGRATE_BATCH) { \
+			long integ_len_ = integ_hi_ - integ_start_; \
+			if (integ_len_ > INTEGRATE_BATCH) \
+				integ_len_ = INTEGRATE_BATCH; \
+			_Pragma("omp simd") \
+			for (integ_k_=0; integ_k_<integ_len_; integ_k_++) { \
+				long j = integ_start_ + integ_k_; \
+				integ_buf_[integ_k_] = (VALUE); \
+			} \
+			for (integ_k_=integ_len_; integ_k_<INTEGRATE_BATCH; integ_k_++) \
+				integ_buf_[integ_k_] = 0.0; \
+\
+			if (integ_accum_ == INTEGRATE_KAHAN) { \
+				int integ_i_, integ_l_; \
+				for (integ_i_=0; integ_i_<INTEGRATE_BATCH; integ_i_+=INTEGRATE_LANES) { \
+					_Pragma("omp simd") \
+					for (integ_l_=0; integ_l_<INTEGRATE_LANES; integ_l_++) { \
+						double y = integ_buf_[integ_i_+integ_l_] - integ_c_[integ_l_]; \
+						double t = integ_s_[integ_l_] + y; \
+						integ_c_[integ_l_] = (t - integ_s_[integ_l_]) - y; \
+						integ_s_[integ_l_] = t; \
+					} \
+				} \
+			} else if (integ_accum_ == INTEGRATE_PAIRWISE) { \
+				/* binary counter: level k holds the sum of 2^k batches */ \
+				double v = integrate_pairwise_batch(integ_buf_); \
+				for (integ_k_=0; integ_batches_ & (1L << integ_k_); integ_k_++) \
+					v = integ_stack_[integ_k_] + v; \
+				integ_stack_[integ_k_] = v; \
+				integ_batches_++; \
+			} else { \
+				_Pragma("omp simd reduction(+:integ_plain_)") \
+				for (integ_k_=0; integ_k_<INTEGRATE_BATCH; integ_k_++) \
+					integ_plain_ += integ_buf_[integ_k_]; \
+			} \
+		} \
+\
+		double integ_sum_ = 0, integ_comp_ = 0; \
+		if (integ_accum_ == INTEGRATE_KAHAN) { \
+			for (integ_k_=0; integ_k_<INTEGRATE_LANES; integ_k_++) { \
+				integrate_kahan_add(&integ_sum_, &integ_comp_, integ_s_[integ_k_]); \
+				integrate_kahan_add(&integ_sum_, &integ_comp_, -integ_c_[integ_k_]); \
+			} \
+			integ_sum_ += integ_comp_; \
+		} else if (integ_accum_ == INTEGRATE_PAIRWISE) { \
+			for (integ_k_=0; integ_k_<64; integ_k_++) { \
+				if (integ_batches_ & (1L << integ_k_)) \
+					integ_sum_ += integ_stack_[integ_k_]; \
+			} \
+		} else { \
+			integ_sum_ = integ_plain_; \
+		} \
+		*(double *) ((char *) integ_partials_ + (size_t) integ_tid_ * INTEGRATE_PAD) = integ_sum_; \
+	} \
+\
+	double integ_total_ = 0, integ_tcomp_ = 0; \
+	int integ_t_; \
+	for (integ_t_=0; integ_t_<integ_team_; integ_t_++) \
+		integrate_kahan_add(&integ_total_, &integ_tcomp_, \
+		                    *(double *) ((char *) integ_partials_ + (size_t) integ_t_ * INTEGRATE_PAD)); \
+	free(integ_partials_); \
+	(RESULT) = integ_total_ + integ_tcomp_; \
+} while (0)
+
+/* Simpson weight of point j out of 2n+1: 1 4 2 4 ... 2 4 1 */
+#define INTEGRATE_SIMPSON_W_(j, last) \
+	(((j) == 0 || (j) == (last)) ? 1.0 : (((j) & 1) ? 4.0 : 2.0))
+
+#define INTEGRATE_DEFINE(NAME, F) \
+\
+static inline double NAME##_midpoint(double a, double b, long n, int accum) \
+{ \
+	double h = (b - a) / n, sum; \
+	INTEGRATE_SUM_(n, F(a + (j + 0.5)*h), accum, sum); \
+	return sum * h; \
+} \
+\
+static inline double NAME##_simpson(double a, double b, long n, int accum) \
+{ \
+	double h = (b - a) / n, sum; \
+	long last = 2*n; \
+	INTEGRATE_SUM_(last + 1, INTEGRATE_SIMPSON_W_(j, last) * F(a + j*(0.5*h)), accum, sum); \
+	return sum * (h / 6.0); \
+} \
+\
+static inline double NAME##_gauss(double a, double b, long n, int order, int accum) \
+{ \
+	double h = (b - a) / n, sum; \
+	if (order < 1 || order > INTEGRATE_GAUSS_MAX) { \
+		fprintf(stderr, "integrate: no Gauss-Legendre rule with %d points\n", order); \
+		exit(1); \
+	} \
+	/* one pass per node, so the points of a pass are evenly spaced and \
+	   vectorize like the midpoint rule */ \
+	double total = 0, comp = 0; \
+	int k; \
+	for (k=0; k<order; k++) { \
+		double shift = 0.5 + 0.5*integrate_gauss_x[order-1][k]; \
+		INTEGRATE_SUM_(n, F(a + (j + shift)*h), accum, sum); \
+		integrate_kahan_add(&total, &comp, integrate_gauss_w[order-1][k] * sum); \
+	} \
+	return (total + comp) * (0.5*h); \
+} \
+\
+/* Simpson on [a, b] is whole, with f at a, (a+b)/2, b given */ \
+static double NAME##_adaptive_(double a, double b, double fa, double fm, double fb, \
+                               double whole, double eps, int depth) \
+{ \
+	double m = 0.5*(a + b); \
+	double lm = 0.5*(a + m), rm = 0.5*(m + b); \
+	double flm = F(lm), frm = F(rm); \
+	double left = (m - a)/6.0 * (fa + 4.0*flm + fm); \
+	double right = (b - m)/6.0 * (fm + 4.0*frm + fb); \
+	double delta = left + right - whole; \
+	if (depth >= INTEGRATE_MAX_DEPTH || fabs(delta) <= 15.0*eps) \
+		return left + right + delta/15.0; \
+\
+	if (depth < INTEGRATE_TASK_LEVELS) { \
+		_Pragma("omp task shared(left)") \
+		left = NAME##_adaptive_(a, m, fa, flm, fm, left, 0.5*eps, depth+1); \
+		right = NAME##_adaptive_(m, b, fm, frm, fb, right, 0.5*eps, depth+1); \
+		_Pragma("omp taskwait") \
+	} else { \
+		left = NAME##_adaptive_(a, m, fa, flm, fm, left, 0.5*eps, depth+1); \
+		right = NAME##_adaptive_(m, b, fm, frm, fb, right, 0.5*eps, depth+1); \
+	} \
+	return left + right; \
+} \
+\
+static inline double NAME##_adaptive(double a, double b, double eps) \
+{ \
+	double fa = F(a), fm = F(0.5*(a + b)), fb = F(b); \
+	double whole = (b - a)/6.0 * (fa + 4.0*fm + fb); \
+	double sum = 0; \
+	_Pragma("omp parallel") \
+	{ \
+		_Pragma("omp single") \
+		sum = NAME##_adaptive_(a, b, fa, fm, fb, whole, eps, 0); \
+	} \
+	return sum; \
+} \
+\
+static inline double NAME##_integrate(int rule, double a, double b, long n, int accum) \
+{ \
+	switch (rule) { \
+	case INTEGRATE_MIDPOINT: \
+		return NAME##_midpoint(a, b, n, accum); \
+	case INTEGRATE_SIMPSON: \
+		return NAME##_simpson(a, b, n, accum); \
+	case INTEGRATE_GAUSS: \
+		return NAME##_gauss(a, b, n, INTEGRATE_GAUSS_ORDER, accum); \
+	default: \
+		return NAME##_adaptive(a, b, 1.0 / n); \
+	} \
+}
+
+#endif
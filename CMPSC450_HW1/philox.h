@@ -0,0 +1,113 @@
+/* Philox4x32-10 counter-based random numbers (Salmon et al., "Parallel
+ * random numbers: as easy as 1, 2, 3", SC11).
+ *
+ * philox4x32(ctr, key, out) turns a 128-bit counter and a 64-bit key into
+ * 128 random bits with ten rounds of multiplies and xors.  There is no
+ * state: the i-th number of a stream is philox4x32({i, ...}, seed), so any
+ * thread can produce any part of the stream, two threads never share
+ * anything, and the numbers don't depend on how the counters are split
+ * over the threads.  The rounds are plain 32x32->64 multiplies, and
+ * philox4x32_batch() runs them over a batch of consecutive counters in simd
+ * loops.
+ */
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u   /* golden ratio */
+#define PHILOX_W1 0xBB67AE85u   /* sqrt(3) - 1 */
+#define PHILOX_ROUNDS 10
+
+static inline void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+{
+	uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	int r;
+	for (r=0; r<PHILOX_ROUNDS; r++) {
+		uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+		uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+		uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t) p1;
+		c3 = (uint32_t) p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+/* philox4x32 of the counters {first + k, 0, 0} for k in [0, len) into
+   out0..out3[k], a round at a time over the whole batch so each round is
+   one simd loop (8 or 16 counters per instruction) */
+static inline void philox4x32_batch(uint64_t first, int len, const uint32_t key[2],
+                                    uint32_t *out0, uint32_t *out1, uint32_t *out2, uint32_t *out3)
+{
+	uint32_t k0 = key[0], k1 = key[1];
+	int k, r;
+	#pragma omp simd
+	for (k=0; k<len; k++) {
+		uint64_t i = first + k;
+		out0[k] = (uint32_t) i;
+		out1[k] = (uint32_t) (i >> 32);
+		out2[k] = 0;
+		out3[k] = 0;
+	}
+	for (r=0; r<PHILOX_ROUNDS; r++) {
+		#pragma omp simd
+		for (k=0; k<len; k++) {
+			uint64_t p0 = (uint64_t) PHILOX_M0 * out0[k];
+			uint64_t p1 = (uint64_t) PHILOX_M1 * out2[k];
+			uint32_t n0 = (uint32_t) (p1 >> 32) ^ out1[k] ^ k0;
+			uint32_t n2 = (uint32_t) (p0 >> 32) ^ out3[k] ^ k1;
+			out1[k] = (uint32_t) p1;
+			out3[k] = (uint32_t) p0;
+			out0[k] = n0;
+			out2[k] = n2;
+		}
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+}
+
+/* a double in [0, 1) from the top 53 of 64 random bits */
+static inline double philox_uniform(uint32_t hi, uint32_t lo)
+{
+	return (double) ((((uint64_t) hi << 32) | lo) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* known answers from the Random123 distribution; 0 when they match */
+static inline int philox_selftest(void)
+{
+	static const uint32_t ctr[2][4] = {
+		{ 0, 0, 0, 0 },
+		{ 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu }
+	};
+	static const uint32_t key[2][2] = {
+		{ 0, 0 },
+		{ 0xffffffffu, 0xffffffffu }
+	};
+	static const uint32_t expect[2][4] = {
+		{ 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+		{ 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu }
+	};
+	int t, i;
+	for (t=0; t<2; t++) {
+		uint32_t out[4];
+		philox4x32(ctr[t], key[t], out);
+		for (i=0; i<4; i++) {
+			if (out[i] != expect[t][i])
+				return 1;
+		}
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,268 @@
+/* Parallel prefix sums (scans).
+ *
+ * The Blelloch up-sweep/down-sweep in stockwell_hw1_prefix_sums.c takes
+ * 2*log2(n) passes over the array with stride 2^i, one parallel region per
+ * level.  The scans here run inside a single parallel region and touch
+ * every element a constant number of times.
+ *
+ * scan_<t>_blocked(in, out, n, mode): three-phase blocked scan
+ *   1. every thread reduces a contiguous block
+ *   2. the per-thread partials are scanned (each thread sums the partials
+ *      left of it, there are only as many as threads)
+ *   3. every thread rescans its block starting from its offset
+ * The array is processed in chunks of SCAN_BLOCK elements per thread, so
+ * a block is rescanned while it is still in cache from the reduce: a chunk
+ * costs one barrier and one read + one write of memory.
+ *
+ * scan_<t>_lookback(in, out, n, mode): single-pass decoupled look-back
+ *   Tiles of SCAN_TILE elements are claimed in order from an atomic
+ *   counter.  A thread reduces its tile, publishes the aggregate (flag A),
+ *   then walks back over the preceding tiles adding aggregates until it
+ *   finds one that has published its inclusive prefix (flag P), publishes
+ *   its own prefix and rescans the tile while it is still in cache.  Every
+ *   element is read from memory once and written once (2n traffic, the
+ *   blocked scan's chunks need the same but pay a barrier each), and a slow
+ *   thread only holds up the tiles right after its own.  For float and
+ *   double the order of the additions depends on timing, so results can
+ *   differ in the last bits from run to run.
+ *
+ * Both call scan_<t>_seq() for the per-block scan, which points at the
+ * AVX2 or AVX-512 in-register kernel from prefix_scan_simd.h when the CPU
+ * has it and at the scalar loop otherwise.
+ *
+ * Instantiated for int32_t (i32), int64_t (i64), float (f32) and double
+ * (f64).  n can be anything, in and out may be the same array, and mode is
+ * SCAN_INCLUSIVE (out[i] = in[0] + ... + in[i]) or SCAN_EXCLUSIVE
+ * (out[i] = in[0] + ... + in[i-1], out[0] = 0).
+ */
+#ifndef PREFIX_SCAN_H
+#define PREFIX_SCAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <sched.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define SCAN_INCLUSIVE 0
+#define SCAN_EXCLUSIVE 1
+
+/* elements per thread per chunk: 64 KB of int32, 128 KB of int64/double,
+   small enough to still be in L2 when the block is rescanned */
+#define SCAN_BLOCK 16384
+
+/* one partial per cache line so the threads don't false-share */
+#define SCAN_PAD 64
+
+/* elements per look-back tile, also sized to stay in L2 */
+#define SCAN_TILE 16384
+
+/* look-back tile states */
+#define SCAN_FLAG_NONE      0   /* nothing published yet */
+#define SCAN_FLAG_AGGREGATE 1   /* the tile's own sum is valid */
+#define SCAN_FLAG_PREFIX    2   /* the inclusive prefix up to the tile is valid */
+
+/* spins before a waiting thread yields, so a look-back doesn't burn the
+   time slice of the thread it waits for when there are more threads than
+   cores */
+#define SCAN_SPINS 1024
+
+static inline int scan_max_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+static inline void scan_team(int *tid, int *nthreads)
+{
+#ifdef _OPENMP
+	*tid = omp_get_thread_num();
+	*nthreads = omp_get_num_threads();
+#else
+	*tid = 0;
+	*nthreads = 1;
+#endif
+}
+
+/* padded scratch for slots partials (or flags), released with free() */
+static inline char *scan_alloc_partials(int slots)
+{
+	void *p = NULL;
+	if (posix_memalign(&p, SCAN_PAD, (size_t) slots * SCAN_PAD) != 0) {
+		fprintf(stderr, "prefix_scan: out of memory\n");
+		exit(1);
+	}
+	return (char *) p;
+}
+
+#define SCAN_SLOT(TYPE, partials, slot) (*(TYPE *) ((partials) + (size_t) (slot) * SCAN_PAD))
+
+/* selected block scan kernels (prefix_scan_simd.h), -1 until the first scan */
+static int scan_isa = -1;
+static inline void scan_select_isa(void);
+
+/* SCAN_DEFINE(TYPE, NAME) defines NAME_reduce, NAME_seq_scalar, the NAME_seq
+   kernel pointer, NAME_blocked and NAME_lookback for element type TYPE */
+#define SCAN_DEFINE(TYPE, NAME) \
+\
+static inline TYPE NAME##_reduce(const TYPE *in, long n) \
+{ \
+	TYPE sum = 0; \
+	long i; \
+	for (i=0; i<n; i++) \
+		sum += in[i]; \
+	return sum; \
+} \
+\
+/* serial scan of in[0..n) starting from carry; returns carry + sum */ \
+static inline TYPE NAME##_seq_scalar(const TYPE *in, TYPE *out, long n, TYPE carry, int mode) \
+{ \
+	long i; \
+	if (mode == SCAN_EXCLUSIVE) { \
+		for (i=0; i<n; i++) { \
+			TYPE x = in[i]; \
+			out[i] = carry; \
+			carry += x; \
+		} \
+	} else { \
+		for (i=0; i<n; i++) { \
+			carry += in[i]; \
+			out[i] = carry; \
+		} \
+	} \
+	return carry; \
+} \
+\
+/* the block scan used by the parallel scans, set by scan_select_isa() */ \
+static TYPE (*NAME##_seq)(const TYPE *, TYPE *, long, TYPE, int) = NAME##_seq_scalar; \
+\
+static inline void NAME##_blocked(const TYPE *in, TYPE *out, long n, int mode) \
+{ \
+	scan_select_isa(); \
+	int max_threads = scan_max_threads(); \
+	/* two sets of partials: a thread can start writing the next chunk's \
+	   partial while slower threads still read this chunk's */ \
+	char *partials = scan_alloc_partials(2*max_threads); \
+\
+	_Pragma("omp parallel") \
+	{ \
+		int tid, nthreads; \
+		scan_team(&tid, &nthreads); \
+		long chunk = (long) nthreads * SCAN_BLOCK; \
+		TYPE carry = 0; \
+		int parity = 0; \
+		long start; \
+		for (start=0; start<n; start+=chunk) { \
+			long len = (n - start < chunk) ? n - start : chunk; \
+			long lo = start + len*tid/nthreads; \
+			long hi = start + len*(tid+1)/nthreads; \
+			int base = parity*max_threads; \
+\
+			SCAN_SLOT(TYPE, partials, base + tid) = NAME##_reduce(in + lo, hi - lo); \
+			_Pragma("omp barrier") \
+\
+			/* every thread adds up the partials in the same order, so \
+			   they all agree on the carry into the next chunk */ \
+			TYPE offset = carry, total = carry; \
+			int t; \
+			for (t=0; t<nthreads; t++) { \
+				if (t == tid) \
+					offset = total; \
+				total += SCAN_SLOT(TYPE, partials, base + t); \
+			} \
+			NAME##_seq(in + lo, out + lo, hi - lo, offset, mode); \
+			carry = total; \
+			parity ^= 1; \
+		} \
+	} \
+\
+	free(partials); \
+} \
+\
+typedef struct { \
+	int flag; \
+	TYPE aggregate; \
+	TYPE prefix; \
+} __attribute__((aligned(SCAN_PAD))) NAME##_tile_t; \
+\
+/* wait for tile j to publish something; returns its flag */ \
+static inline int NAME##_wait(NAME##_tile_t *tile) \
+{ \
+	int spins = 0, flag; \
+	while ((flag = __atomic_load_n(&tile->flag, __ATOMIC_ACQUIRE)) == SCAN_FLAG_NONE) { \
+		if (++spins == SCAN_SPINS) { \
+			sched_yield(); \
+			spins = 0; \
+		} \
+	} \
+	return flag; \
+} \
+\
+static inline void NAME##_lookback(const TYPE *in, TYPE *out, long n, int mode) \
+{ \
+	scan_select_isa(); \
+	long ntiles = (n + SCAN_TILE - 1) / SCAN_TILE; \
+	if (ntiles == 0) \
+		return; \
+	NAME##_tile_t *tiles = NULL; \
+	if (posix_memalign((void **) &tiles, SCAN_PAD, ntiles * sizeof(NAME##_tile_t)) != 0) { \
+		fprintf(stderr, "prefix_scan: out of memory\n"); \
+		exit(1); \
+	} \
+	memset(tiles, 0, ntiles * sizeof(NAME##_tile_t)); \
+	long next = 0; \
+\
+	_Pragma("omp parallel") \
+	{ \
+		for (;;) { \
+			/* claiming in order means every earlier tile has an owner \
+			   that is already running, so the look-back can't deadlock */ \
+			long t = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED); \
+			if (t >= ntiles) \
+				break; \
+			long lo = t * SCAN_TILE; \
+			long len = (n - lo < SCAN_TILE) ? n - lo : SCAN_TILE; \
+			TYPE aggregate = NAME##_reduce(in + lo, len); \
+\
+			TYPE exclusive = 0; \
+			if (t == 0) { \
+				tiles[t].prefix = aggregate; \
+				__atomic_store_n(&tiles[t].flag, SCAN_FLAG_PREFIX, __ATOMIC_RELEASE); \
+			} else { \
+				tiles[t].aggregate = aggregate; \
+				__atomic_store_n(&tiles[t].flag, SCAN_FLAG_AGGREGATE, __ATOMIC_RELEASE); \
+\
+				long j; \
+				for (j=t-1; j>=0; j--) { \
+					if (NAME##_wait(&tiles[j]) == SCAN_FLAG_PREFIX) { \
+						exclusive += tiles[j].prefix; \
+						break; \
+					} \
+					exclusive += tiles[j].aggregate; \
+				} \
+				tiles[t].prefix = exclusive + aggregate; \
+				__atomic_store_n(&tiles[t].flag, SCAN_FLAG_PREFIX, __ATOMIC_RELEASE); \
+			} \
+\
+			NAME##_seq(in + lo, out + lo, len, exclusive, mode); \
+		} \
+	} \
+\
+	free(tiles); \
+}
+
+SCAN_DEFINE(int32_t, scan_i32)
+SCAN_DEFINE(int64_t, scan_i64)
+SCAN_DEFINE(float, scan_f32)
+SCAN_DEFINE(double, scan_f64)
+
+#include "prefix_scan_simd.h"
+
+#endif
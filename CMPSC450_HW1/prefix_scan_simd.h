@@ -0,0 +1,403 @@
+/* SIMD block scans for prefix_scan.h, included from there.
+ *
+ * Each vector is scanned in registers with log2(width) shift-and-add
+ * steps, then the running total from the previous vector is added and
+ * its last lane broadcast as the carry into the next one:
+ *
+ *   x = [a b c d]  ->  [a  a+b  b+c  c+d]  ->  [a  a+b  a+b+c  a+b+c+d]
+ *
+ * AVX2 shifts only within 128-bit lanes, so the upper lane also gets the
+ * lower lane's total added; AVX-512 shifts across the whole register with
+ * valignd/valignq.  The exclusive scan shifts the scanned vector by one
+ * more lane instead of subtracting the input, so float and double give
+ * the same rounding in both modes.  For float and double the additions
+ * are grouped differently from the scalar loop, so the last bits can
+ * differ from it.
+ *
+ * The kernels are compiled with #pragma GCC target, so the file builds
+ * without -mavx2/-mavx512f; scan_select_isa() picks the widest one the
+ * CPU supports with __builtin_cpu_supports() the first time a scan runs,
+ * and --scan-isa=scalar|avx2|avx512 (scan_isa_args()) overrides it.
+ */
+#ifndef PREFIX_SCAN_SIMD_H
+#define PREFIX_SCAN_SIMD_H
+
+#include <string.h>
+
+enum { SCAN_ISA_SCALAR, SCAN_ISA_AVX2, SCAN_ISA_AVX512, SCAN_ISA_NUM };
+
+static const char *scan_isa_names[SCAN_ISA_NUM] = { "scalar", "avx2", "avx512" };
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* the vector loop shared by every kernel: PREFIX scans one vector, SHIFT1
+   moves it up by one lane, LAST broadcasts its last lane, and TAIL (the
+   scalar scan) finishes the elements that don't fill a vector */
+#define SCAN_SIMD_LOOP(TYPE, VEC, WIDTH, LOAD, STORE, ADD, SET1, PREFIX, SHIFT1, LAST, TAIL) \
+	long i = 0; \
+	VEC c = SET1(carry); \
+	if (mode == SCAN_EXCLUSIVE) { \
+		for (; i + WIDTH <= n; i += WIDTH) { \
+			VEC s = PREFIX(LOAD(in + i)); \
+			STORE(out + i, ADD(SHIFT1(s), c)); \
+			c = LAST(ADD(s, c)); \
+		} \
+	} else { \
+		for (; i + WIDTH <= n; i += WIDTH) { \
+			VEC r = ADD(PREFIX(LOAD(in + i)), c); \
+			STORE(out + i, r); \
+			c = LAST(r); \
+		} \
+	} \
+	TYPE lanes[WIDTH]; \
+	STORE(lanes, c); \
+	return TAIL(in + i, out + i, n - i, lanes[0], mode);
+
+#ifdef SCAN_HAVE_X86
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+/* int32, 8 lanes */
+#define scan_i32_load_avx2(p)     _mm256_loadu_si256((const __m256i *) (p))
+#define scan_i32_store_avx2(p, v) _mm256_storeu_si256((__m256i *) (p), v)
+
+static inline __m256i scan_i32_prefix_avx2(__m256i x)
+{
+	x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+	x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+	/* add the lower lane's total to the upper lane */
+	__m256i t = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3,3,3,3));
+	t = _mm256_permute2x128_si256(t, t, 0x08);
+	return _mm256_add_epi32(x, t);
+}
+
+static inline __m256i scan_i32_shift1_avx2(__m256i x)
+{
+	x = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+	return _mm256_blend_epi32(x, _mm256_setzero_si256(), 0x01);
+}
+
+static inline __m256i scan_i32_last_avx2(__m256i x)
+{
+	return _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+}
+
+/* int64, 4 lanes */
+#define scan_i64_load_avx2(p)     _mm256_loadu_si256((const __m256i *) (p))
+#define scan_i64_store_avx2(p, v) _mm256_storeu_si256((__m256i *) (p), v)
+
+static inline __m256i scan_i64_prefix_avx2(__m256i x)
+{
+	x = _mm256_add_epi64(x, _mm256_slli_si256(x, 8));
+	__m256i t = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1,1,1,1));
+	t = _mm256_blend_epi32(_mm256_setzero_si256(), t, 0xF0);
+	return _mm256_add_epi64(x, t);
+}
+
+static inline __m256i scan_i64_shift1_avx2(__m256i x)
+{
+	x = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(2,1,0,0));
+	return _mm256_blend_epi32(x, _mm256_setzero_si256(), 0x03);
+}
+
+static inline __m256i scan_i64_last_avx2(__m256i x)
+{
+	return _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3,3,3,3));
+}
+
+/* float, 8 lanes */
+#define scan_f32_load_avx2(p)     _mm256_loadu_ps(p)
+#define scan_f32_store_avx2(p, v) _mm256_storeu_ps(p, v)
+
+static inline __m256 scan_f32_prefix_avx2(__m256 x)
+{
+	x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+	x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+	__m256 t = _mm256_permute_ps(x, _MM_SHUFFLE(3,3,3,3));
+	t = _mm256_permute2f128_ps(t, t, 0x08);
+	return _mm256_add_ps(x, t);
+}
+
+static inline __m256 scan_f32_shift1_avx2(__m256 x)
+{
+	x = _mm256_permutevar8x32_ps(x, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+	return _mm256_blend_ps(x, _mm256_setzero_ps(), 0x01);
+}
+
+static inline __m256 scan_f32_last_avx2(__m256 x)
+{
+	return _mm256_permutevar8x32_ps(x, _mm256_set1_epi32(7));
+}
+
+/* double, 4 lanes */
+#define scan_f64_load_avx2(p)     _mm256_loadu_pd(p)
+#define scan_f64_store_avx2(p, v) _mm256_storeu_pd(p, v)
+
+static inline __m256d scan_f64_prefix_avx2(__m256d x)
+{
+	x = _mm256_add_pd(x, _mm256_castsi256_pd(_mm256_slli_si256(_mm256_castpd_si256(x), 8)));
+	__m256d t = _mm256_permute4x64_pd(x, _MM_SHUFFLE(1,1,1,1));
+	t = _mm256_blend_pd(_mm256_setzero_pd(), t, 0x0C);
+	return _mm256_add_pd(x, t);
+}
+
+static inline __m256d scan_f64_shift1_avx2(__m256d x)
+{
+	x = _mm256_permute4x64_pd(x, _MM_SHUFFLE(2,1,0,0));
+	return _mm256_blend_pd(x, _mm256_setzero_pd(), 0x01);
+}
+
+static inline __m256d scan_f64_last_avx2(__m256d x)
+{
+	return _mm256_permute4x64_pd(x, _MM_SHUFFLE(3,3,3,3));
+}
+
+static int32_t scan_i32_seq_avx2(const int32_t *in, int32_t *out, long n, int32_t carry, int mode)
+{
+	SCAN_SIMD_LOOP(int32_t, __m256i, 8, scan_i32_load_avx2, scan_i32_store_avx2,
+	               _mm256_add_epi32, _mm256_set1_epi32, scan_i32_prefix_avx2,
+	               scan_i32_shift1_avx2, scan_i32_last_avx2,
+	               scan_i32_seq_scalar)
+}
+
+static int64_t scan_i64_seq_avx2(const int64_t *in, int64_t *out, long n, int64_t carry, int mode)
+{
+	SCAN_SIMD_LOOP(int64_t, __m256i, 4, scan_i64_load_avx2, scan_i64_store_avx2,
+	               _mm256_add_epi64, _mm256_set1_epi64x, scan_i64_prefix_avx2,
+	               scan_i64_shift1_avx2, scan_i64_last_avx2,
+	               scan_i64_seq_scalar)
+}
+
+static float scan_f32_seq_avx2(const float *in, float *out, long n, float carry, int mode)
+{
+	SCAN_SIMD_LOOP(float, __m256, 8, scan_f32_load_avx2, scan_f32_store_avx2,
+	               _mm256_add_ps, _mm256_set1_ps, scan_f32_prefix_avx2,
+	               scan_f32_shift1_avx2, scan_f32_last_avx2,
+	               scan_f32_seq_scalar)
+}
+
+static double scan_f64_seq_avx2(const double *in, double *out, long n, double carry, int mode)
+{
+	SCAN_SIMD_LOOP(double, __m256d, 4, scan_f64_load_avx2, scan_f64_store_avx2,
+	               _mm256_add_pd, _mm256_set1_pd, scan_f64_prefix_avx2,
+	               scan_f64_shift1_avx2, scan_f64_last_avx2,
+	               scan_f64_seq_scalar)
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+/* int32, 16 lanes: valignd with zero shifts across the whole register */
+#define scan_i32_load_avx512(p)     _mm512_loadu_si512((const void *) (p))
+#define scan_i32_store_avx512(p, v) _mm512_storeu_si512((void *) (p), v)
+
+static inline __m512i scan_i32_prefix_avx512(__m512i x)
+{
+	const __m512i z = _mm512_setzero_si512();
+	x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, z, 15));
+	x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, z, 14));
+	x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, z, 12));
+	x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, z, 8));
+	return x;
+}
+
+static inline __m512i scan_i32_shift1_avx512(__m512i x)
+{
+	return _mm512_alignr_epi32(x, _mm512_setzero_si512(), 15);
+}
+
+static inline __m512i scan_i32_last_avx512(__m512i x)
+{
+	return _mm512_permutexvar_epi32(_mm512_set1_epi32(15), x);
+}
+
+/* int64, 8 lanes */
+#define scan_i64_load_avx512(p)     _mm512_loadu_si512((const void *) (p))
+#define scan_i64_store_avx512(p, v) _mm512_storeu_si512((void *) (p), v)
+
+static inline __m512i scan_i64_prefix_avx512(__m512i x)
+{
+	const __m512i z = _mm512_setzero_si512();
+	x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, z, 7));
+	x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, z, 6));
+	x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, z, 4));
+	return x;
+}
+
+static inline __m512i scan_i64_shift1_avx512(__m512i x)
+{
+	return _mm512_alignr_epi64(x, _mm512_setzero_si512(), 7);
+}
+
+static inline __m512i scan_i64_last_avx512(__m512i x)
+{
+	return _mm512_permutexvar_epi64(_mm512_set1_epi64(7), x);
+}
+
+/* float, 16 lanes */
+#define scan_f32_load_avx512(p)     _mm512_loadu_ps(p)
+#define scan_f32_store_avx512(p, v) _mm512_storeu_ps(p, v)
+#define SCAN_F32_ALIGN(x, k) \
+	_mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), _mm512_setzero_si512(), k))
+
+static inline __m512 scan_f32_prefix_avx512(__m512 x)
+{
+	x = _mm512_add_ps(x, SCAN_F32_ALIGN(x, 15));
+	x = _mm512_add_ps(x, SCAN_F32_ALIGN(x, 14));
+	x = _mm512_add_ps(x, SCAN_F32_ALIGN(x, 12));
+	x = _mm512_add_ps(x, SCAN_F32_ALIGN(x, 8));
+	return x;
+}
+
+static inline __m512 scan_f32_shift1_avx512(__m512 x)
+{
+	return SCAN_F32_ALIGN(x, 15);
+}
+
+static inline __m512 scan_f32_last_avx512(__m512 x)
+{
+	return _mm512_permutexvar_ps(_mm512_set1_epi32(15), x);
+}
+
+/* double, 8 lanes */
+#define scan_f64_load_avx512(p)     _mm512_loadu_pd(p)
+#define scan_f64_store_avx512(p, v) _mm512_storeu_pd(p, v)
+#define SCAN_F64_ALIGN(x, k) \
+	_mm512_castsi512_pd(_mm512_alignr_epi64(_mm512_castpd_si512(x), _mm512_setzero_si512(), k))
+
+static inline __m512d scan_f64_prefix_avx512(__m512d x)
+{
+	x = _mm512_add_pd(x, SCAN_F64_ALIGN(x, 7));
+	x = _mm512_add_pd(x, SCAN_F64_ALIGN(x, 6));
+	x = _mm512_add_pd(x, SCAN_F64_ALIGN(x, 4));
+	return x;
+}
+
+static inline __m512d scan_f64_shift1_avx512(__m512d x)
+{
+	return SCAN_F64_ALIGN(x, 7);
+}
+
+static inline __m512d scan_f64_last_avx512(__m512d x)
+{
+	return _mm512_permutexvar_pd(_mm512_set1_epi64(7), x);
+}
+
+static int32_t scan_i32_seq_avx512(const int32_t *in, int32_t *out, long n, int32_t carry, int mode)
+{
+	SCAN_SIMD_LOOP(int32_t, __m512i, 16, scan_i32_load_avx512, scan_i32_store_avx512,
+	               _mm512_add_epi32, _mm512_set1_epi32, scan_i32_prefix_avx512,
+	               scan_i32_shift1_avx512, scan_i32_last_avx512,
+	               scan_i32_seq_scalar)
+}
+
+static int64_t scan_i64_seq_avx512(const int64_t *in, int64_t *out, long n, int64_t carry, int mode)
+{
+	SCAN_SIMD_LOOP(int64_t, __m512i, 8, scan_i64_load_avx512, scan_i64_store_avx512,
+	               _mm512_add_epi64, _mm512_set1_epi64, scan_i64_prefix_avx512,
+	               scan_i64_shift1_avx512, scan_i64_last_avx512,
+	               scan_i64_seq_scalar)
+}
+
+static float scan_f32_seq_avx512(const float *in, float *out, long n, float carry, int mode)
+{
+	SCAN_SIMD_LOOP(float, __m512, 16, scan_f32_load_avx512, scan_f32_store_avx512,
+	               _mm512_add_ps, _mm512_set1_ps, scan_f32_prefix_avx512,
+	               scan_f32_shift1_avx512, scan_f32_last_avx512,
+	               scan_f32_seq_scalar)
+}
+
+static double scan_f64_seq_avx512(const double *in, double *out, long n, double carry, int mode)
+{
+	SCAN_SIMD_LOOP(double, __m512d, 8, scan_f64_load_avx512, scan_f64_store_avx512,
+	               _mm512_add_pd, _mm512_set1_pd, scan_f64_prefix_avx512,
+	               scan_f64_shift1_avx512, scan_f64_last_avx512,
+	               scan_f64_seq_scalar)
+}
+
+#pragma GCC pop_options
+
+#endif /* SCAN_HAVE_X86 */
+
+/* best ISA this CPU supports */
+static inline int scan_detect_isa(void)
+{
+#ifdef SCAN_HAVE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SCAN_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SCAN_ISA_AVX2;
+#endif
+	return SCAN_ISA_SCALAR;
+}
+
+/* point the block scans at the kernels for isa (the best supported one
+   if the CPU lacks it) */
+static inline void scan_set_isa(int isa)
+{
+	int best = scan_detect_isa();
+	if (isa > best) {
+		fprintf(stderr, "scan: %s not supported by this CPU, using %s\n",
+				scan_isa_names[isa], scan_isa_names[best]);
+		isa = best;
+	}
+	scan_isa = isa;
+
+	scan_i32_seq = scan_i32_seq_scalar;
+	scan_i64_seq = scan_i64_seq_scalar;
+	scan_f32_seq = scan_f32_seq_scalar;
+	scan_f64_seq = scan_f64_seq_scalar;
+#ifdef SCAN_HAVE_X86
+	if (isa == SCAN_ISA_AVX2) {
+		scan_i32_seq = scan_i32_seq_avx2;
+		scan_i64_seq = scan_i64_seq_avx2;
+		scan_f32_seq = scan_f32_seq_avx2;
+		scan_f64_seq = scan_f64_seq_avx2;
+	} else if (isa == SCAN_ISA_AVX512) {
+		scan_i32_seq = scan_i32_seq_avx512;
+		scan_i64_seq = scan_i64_seq_avx512;
+		scan_f32_seq = scan_f32_seq_avx512;
+		scan_f64_seq = scan_f64_seq_avx512;
+	}
+#endif
+}
+
+static inline void scan_select_isa(void)
+{
+	if (scan_isa < 0)
+		scan_set_isa(scan_detect_isa());
+}
+
+/* Remove --scan-isa=<isa> from argv and select the kernels; without the
+   flag the best supported ISA is picked on the first scan. */
+static inline void scan_isa_args(int *argc, char **argv)
+{
+	int i, j = 1;
+	for (i=1; i<*argc; i++) {
+		if (strncmp(argv[i], "--scan-isa=", 11) != 0) {
+			argv[j++] = argv[i];
+			continue;
+		}
+		int isa;
+		for (isa=0; isa<SCAN_ISA_NUM; isa++) {
+			if (strcmp(argv[i] + 11, scan_isa_names[isa]) == 0)
+				break;
+		}
+		if (isa == SCAN_ISA_NUM) {
+			fprintf(stderr, "unknown scan ISA %s, use scalar, avx2 or avx512\n", argv[i] + 11);
+			exit(1);
+		}
+		scan_set_isa(isa);
+	}
+	*argc = j;
+	argv[j] = NULL;
+}
+
+#endif
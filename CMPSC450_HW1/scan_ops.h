@@ -0,0 +1,196 @@
+/* Scan-based parallel primitives built on prefix_scan.h.
+ *
+ * scan_<t>_segmented(in, heads, out, n, mode)
+ *   inclusive or exclusive scan that restarts at every i with heads[i]
+ *   nonzero (the exclusive scan writes 0 there).  Same chunked three-phase
+ *   structure as scan_<t>_blocked; a block's partial is its sum since its
+ *   last head plus whether it has one, so the offset into a block stops
+ *   accumulating at the nearest block to its left that starts a segment.
+ *
+ * SCAN_FILTER(TYPE, IN, OUT, N, COUNT, KEEP)
+ *   parallel_filter/compact: copies the elements p of IN for which KEEP(p)
+ *   is true to OUT, in order, and sets COUNT to how many there were.  Each
+ *   thread counts the kept elements of its block, the counts are scanned
+ *   into output offsets, and each thread scatters its block.
+ * SCAN_PARTITION(TYPE, IN, OUT, N, COUNT, KEEP)
+ *   stable partition: the elements with KEEP(p) first, then the rest, both
+ *   in their original order; COUNT is the size of the first part.
+ *
+ * Like QSORT's islt, KEEP receives a pointer to the element and can be a
+ * macro, so the predicate is inlined:
+ *   #define is_odd(p) ((*(p)) & 1)
+ *   long kept;
+ *   SCAN_FILTER(int32_t, A, B, n, kept, is_odd);
+ * OUT must not overlap IN, and KEEP must give the same answer both times
+ * it is evaluated on an element.
+ *
+ * For int32_t, int64_t, float and double there are also functions taking
+ * the predicate as a pointer, and a compaction by a flags array:
+ *   scan_<t>_filter(in, out, n, pred), scan_<t>_partition(in, out, n, pred)
+ *   scan_<t>_compact(in, flags, out, n)
+ */
+#ifndef SCAN_OPS_H
+#define SCAN_OPS_H
+
+#include "prefix_scan.h"
+
+/* counts and scatters with one block per thread: the partition needs the
+   total count before any element can be placed */
+#define SCAN_SCATTER_(TYPE, IN, OUT, N, COUNT, KEEP, PARTITION) do { \
+	const TYPE *scan_in_ = (IN); \
+	TYPE *scan_out_ = (OUT); \
+	long scan_n_ = (N); \
+	long scan_total_ = 0; \
+	char *scan_counts_ = scan_alloc_partials(scan_max_threads()); \
+\
+	_Pragma("omp parallel") \
+	{ \
+		int scan_tid_, scan_nt_, scan_t_; \
+		scan_team(&scan_tid_, &scan_nt_); \
+		long scan_lo_ = scan_n_*scan_tid_/scan_nt_; \
+		long scan_hi_ = scan_n_*(scan_tid_+1)/scan_nt_; \
+		long scan_i_, scan_k_ = 0; \
+		for (scan_i_=scan_lo_; scan_i_<scan_hi_; scan_i_++) { \
+			if (KEEP(scan_in_ + scan_i_)) \
+				scan_k_++; \
+		} \
+		SCAN_SLOT(long, scan_counts_, scan_tid_) = scan_k_; \
+		_Pragma("omp barrier") \
+\
+		/* kept elements go after the kept ones of the threads to the \
+		   left, the others (for a partition) after all kept ones and \
+		   the others of the threads to the left */ \
+		long scan_keep_ = 0, scan_all_ = 0; \
+		for (scan_t_=0; scan_t_<scan_nt_; scan_t_++) { \
+			long scan_c_ = SCAN_SLOT(long, scan_counts_, scan_t_); \
+			if (scan_t_ < scan_tid_) \
+				scan_keep_ += scan_c_; \
+			scan_all_ += scan_c_; \
+		} \
+		long scan_drop_ = scan_all_ + (scan_lo_ - scan_keep_); \
+		if (scan_tid_ == 0) \
+			scan_total_ = scan_all_; \
+		for (scan_i_=scan_lo_; scan_i_<scan_hi_; scan_i_++) { \
+			if (KEEP(scan_in_ + scan_i_)) \
+				scan_out_[scan_keep_++] = scan_in_[scan_i_]; \
+			else if (PARTITION) \
+				scan_out_[scan_drop_++] = scan_in_[scan_i_]; \
+		} \
+	} \
+\
+	free(scan_counts_); \
+	(COUNT) = scan_total_; \
+} while (0)
+
+#define SCAN_FILTER(TYPE, IN, OUT, N, COUNT, KEEP) \
+	SCAN_SCATTER_(TYPE, IN, OUT, N, COUNT, KEEP, 0)
+
+#define SCAN_PARTITION(TYPE, IN, OUT, N, COUNT, KEEP) \
+	SCAN_SCATTER_(TYPE, IN, OUT, N, COUNT, KEEP, 1)
+
+/* KEEP for the compaction: the flag of the element p points at, using the
+   flags and in arguments of scan_<t>_compact() */
+#define SCAN_KEEP_FLAGGED_(p) (flags[(p) - in])
+
+/* SCAN_OPS_DEFINE(TYPE, NAME) defines NAME_segmented, NAME_filter,
+   NAME_partition and NAME_compact for element type TYPE */
+#define SCAN_OPS_DEFINE(TYPE, NAME) \
+\
+typedef struct { \
+	TYPE sum;   /* sum since the block's last head (or its start) */ \
+	int head;   /* the block starts a segment somewhere */ \
+} NAME##_seg_t; \
+\
+static inline void NAME##_segmented(const TYPE *in, const unsigned char *heads, \
+                                    TYPE *out, long n, int mode) \
+{ \
+	int max_threads = scan_max_threads(); \
+	char *partials = scan_alloc_partials(2*max_threads); \
+\
+	_Pragma("omp parallel") \
+	{ \
+		int tid, nthreads; \
+		scan_team(&tid, &nthreads); \
+		long chunk = (long) nthreads * SCAN_BLOCK; \
+		TYPE carry = 0; \
+		int parity = 0; \
+		long start, i; \
+		for (start=0; start<n; start+=chunk) { \
+			long len = (n - start < chunk) ? n - start : chunk; \
+			long lo = start + len*tid/nthreads; \
+			long hi = start + len*(tid+1)/nthreads; \
+			int base = parity*max_threads; \
+\
+			NAME##_seg_t mine = { 0, 0 }; \
+			for (i=lo; i<hi; i++) { \
+				if (heads[i]) { \
+					mine.sum = 0; \
+					mine.head = 1; \
+				} \
+				mine.sum += in[i]; \
+			} \
+			SCAN_SLOT(NAME##_seg_t, partials, base + tid) = mine; \
+			_Pragma("omp barrier") \
+\
+			TYPE offset = carry, total = carry; \
+			int t; \
+			for (t=0; t<nthreads; t++) { \
+				NAME##_seg_t p = SCAN_SLOT(NAME##_seg_t, partials, base + t); \
+				if (t == tid) \
+					offset = total; \
+				total = p.head ? p.sum : total + p.sum; \
+			} \
+\
+			TYPE run = offset; \
+			if (mode == SCAN_EXCLUSIVE) { \
+				for (i=lo; i<hi; i++) { \
+					TYPE x = in[i]; \
+					if (heads[i]) \
+						run = 0; \
+					out[i] = run; \
+					run += x; \
+				} \
+			} else { \
+				for (i=lo; i<hi; i++) { \
+					if (heads[i]) \
+						run = 0; \
+					run += in[i]; \
+					out[i] = run; \
+				} \
+			} \
+			carry = total; \
+			parity ^= 1; \
+		} \
+	} \
+\
+	free(partials); \
+} \
+\
+static inline long NAME##_filter(const TYPE *in, TYPE *out, long n, int (*pred)(const TYPE *)) \
+{ \
+	long count; \
+	SCAN_FILTER(TYPE, in, out, n, count, pred); \
+	return count; \
+} \
+\
+static inline long NAME##_partition(const TYPE *in, TYPE *out, long n, int (*pred)(const TYPE *)) \
+{ \
+	long count; \
+	SCAN_PARTITION(TYPE, in, out, n, count, pred); \
+	return count; \
+} \
+\
+/* keep in[i] where flags[i] is nonzero */ \
+static inline long NAME##_compact(const TYPE *in, const unsigned char *flags, TYPE *out, long n) \
+{ \
+	long count; \
+	SCAN_FILTER(TYPE, in, out, n, count, SCAN_KEEP_FLAGGED_); \
+	return count; \
+}
+
+SCAN_OPS_DEFINE(int32_t, scan_i32)
+SCAN_OPS_DEFINE(int64_t, scan_i64)
+SCAN_OPS_DEFINE(float, scan_f32)
+SCAN_OPS_DEFINE(double, scan_f64)
+
+#endif
@@ -1,36 +1,275 @@
-/* compile the code with gcc -O3 stockwell_hw1_bandwidth_bench.c -o hw*/
+/* compile the code with gcc -O3 stockwell_hw1_bandwidth_bench.c -lm -o hw*/
+/* add -fopenmp to enable the multi-threaded STREAM kernels */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
 #include <sys/time.h>
 #include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
 
-static double timer() 
-{
-    
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-    /* The code below is for another high resolution timer */
-    /* I'm using gettimeofday because it's more portable */
-    /*
-    struct timespec tp;
-    clock_gettime(CLOCK_MONOTONIC, &tp);
-    return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-    */
+/* STREAM-style kernels: copy, scale, add, triad */
+#define STREAM_NUM_KERNELS 4
+
+static const char *stream_names[STREAM_NUM_KERNELS] = {
+    "Copy", "Scale", "Add", "Triad"
+};
+
+/* doubles moved per element: loads + stores, write-allocate not counted */
+static const int stream_words[STREAM_NUM_KERNELS] = { 2, 2, 3, 3 };
+
+/* flops per element, so the roofline tool can place the kernels */
+static const int stream_flops[STREAM_NUM_KERNELS] = { 0, 1, 1, 2 };
+
+static int stream_bench(const int n, const int num_threads, const int num_iterations) {
+
+    double *a, *b, *c;
+    a = (double *) bench_alloc(n * sizeof(double));
+    assert(a != 0);
+    b = (double *) bench_alloc(n * sizeof(double));
+    assert(b != 0);
+    c = (double *) bench_alloc(n * sizeof(double));
+    assert(c != 0);
+
+#ifdef _OPENMP
+    omp_set_dynamic(0);
+    omp_set_num_threads(num_threads);
+#endif
+
+    int i;
+
+    /* first touch in parallel, with the same static schedule the kernels
+       use, so every page lands on the socket of the thread that streams it */
+#pragma omp parallel for private(i) schedule(static)
+    for (i=0; i<n; i++) {
+        a[i] = 1.0;
+        b[i] = 2.0;
+        c[i] = 0.0;
+    }
+
+    /* STREAM uses 3.0; 0.4 keeps the values from overflowing when
+       small n runs thousands of iterations */
+    const double scalar = 0.4;
+
+    bench_t bench[STREAM_NUM_KERNELS];
+    int k;
+    for (k=0; k<STREAM_NUM_KERNELS; k++) {
+        bench_init(&bench[k], stream_names[k], num_iterations);
+        bench_set_work(&bench[k], 8.0*stream_words[k]*n, 1.0*stream_flops[k]*n);
+    }
+
+    int iter;
+    for (iter=0; iter<num_iterations; iter++) {
+        double elt[STREAM_NUM_KERNELS];
+        double counts[STREAM_NUM_KERNELS][BENCH_PERF_NUM_EVENTS];
+
+        bench_perf_start();
+        elt[0] = bench_now();
+#pragma omp parallel for private(i) schedule(static)
+        for (i=0; i<n; i++) {
+            c[i] = a[i];
+        }
+        elt[0] = bench_now() - elt[0];
+        bench_perf_stop(counts[0]);
+
+        bench_perf_start();
+        elt[1] = bench_now();
+#pragma omp parallel for private(i) schedule(static)
+        for (i=0; i<n; i++) {
+            b[i] = scalar*c[i];
+        }
+        elt[1] = bench_now() - elt[1];
+        bench_perf_stop(counts[1]);
+
+        bench_perf_start();
+        elt[2] = bench_now();
+#pragma omp parallel for private(i) schedule(static)
+        for (i=0; i<n; i++) {
+            c[i] = a[i] + b[i];
+        }
+        elt[2] = bench_now() - elt[2];
+        bench_perf_stop(counts[2]);
+
+        bench_perf_start();
+        elt[3] = bench_now();
+#pragma omp parallel for private(i) schedule(static)
+        for (i=0; i<n; i++) {
+            a[i] = b[i] + scalar*c[i];
+        }
+        elt[3] = bench_now() - elt[3];
+        bench_perf_stop(counts[3]);
+
+        /* the warmup passes pay for page faults and cold caches; the
+           iteration count stays fixed so the values can be verified */
+        if (iter < bench_warmup && iter < num_iterations-1)
+            continue;
+
+        for (k=0; k<STREAM_NUM_KERNELS; k++) {
+            bench_record(&bench[k], elt[k]);
+            bench_record_perf(&bench[k], counts[k]);
+        }
+    }
+
+    /* correctness check: every element follows the same recurrence */
+    double aj = 1.0, bj = 2.0, cj = 0.0;
+    for (iter=0; iter<num_iterations; iter++) {
+        cj = aj;
+        bj = scalar*cj;
+        cj = aj + bj;
+        aj = bj + scalar*cj;
+    }
+    for (i=0; i<n; i++) {
+        assert(fabs(a[i] - aj) <= 1e-12*fabs(aj));
+        assert(fabs(b[i] - bj) <= 1e-12*fabs(bj));
+        assert(fabs(c[i] - cj) <= 1e-12*fabs(cj));
+    }
+
+    fprintf(stderr, "n: %d, threads: %d, num_iterations: %d\n",
+            n, num_threads, num_iterations);
+    fprintf(stderr, "Memory per array: %9.3lf MB, total: %9.3lf MB\n",
+            8.0*n/1e6, 3*8.0*n/1e6);
+    fprintf(stderr, "Kernel   Best GB/s   Avg time (s)   Min time (s)\n");
+    for (k=0; k<STREAM_NUM_KERNELS; k++) {
+        bench_stats_t st = bench_stats(&bench[k]);
+        fprintf(stderr, "%-6s %11.3lf %14.6lf %14.6lf\n",
+                stream_names[k], bench[k].bytes/(st.min*1e9),
+                st.mean, st.min);
+    }
+    for (k=0; k<STREAM_NUM_KERNELS; k++) {
+        bench_report(&bench[k]);
+        bench_destroy(&bench[k]);
+    }
+
+    bench_free(a);
+    bench_free(b);
+    bench_free(c);
+
+    return 0;
+}
+
+
+/* single-threaded read-sum over A, repeated num_iterations times */
+static long read_sum(const int *A, const int n, const int num_iterations) {
+
+    long total_sum = 0;
+    int i, iter;
+    for ( iter=0; iter<num_iterations; iter++) {
+        int sum = 0;
+        for (i=0; i<n; i++) {
+            sum += A[i];
+        }
+        total_sum += sum;
+    }
+    return total_sum;
+}
+
+/* Working-set sweep: grow the array geometrically from min_bytes to
+   max_bytes and write size vs. read bandwidth to a CSV file.  The number
+   of iterations is calibrated per point so each one runs for roughly
+   target_time seconds, which keeps the small (L1) points from being
+   timer noise and the large (DRAM) points from taking forever. */
+#define SWEEP_MIN_BYTES     4096L
+#define SWEEP_STEPS_PER_2X  4
+#define SWEEP_TARGET_TIME   0.2
+
+static int sweep_bench(const char *filename, const long max_bytes) {
+
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        fprintf(stderr, "could not open %s for writing\n", filename);
+        exit(1);
+    }
+
+    int max_n = (int) (max_bytes / sizeof(int));
+    int *A;
+    A = (int *) bench_alloc(max_n * sizeof(int));
+    assert(A != 0);
+
+    int i;
+    for (i=0; i<max_n; i++) {
+        A[i] = (i & 3);
+    }
+
+    fprintf(out, "bytes,n,iterations,seconds,gb_per_s\n");
+    fprintf(stderr, "%12s %10s %12s\n", "bytes", "iterations", "GB/s");
+
+    int step;
+    int last_n = 0;
+    for (step=0; ; step++) {
+        long bytes = (long) (SWEEP_MIN_BYTES * pow(2.0, (double) step/SWEEP_STEPS_PER_2X));
+        if (bytes > max_bytes)
+            break;
+        int n = (int) ((bytes / sizeof(int)) / 4) * 4;
+        if (n == last_n)
+            continue;
+        last_n = n;
+
+        /* calibrate: double the iterations until the run is measurable,
+           then scale to the target time */
+        int num_iterations = 1;
+        double elt;
+        volatile long sink;
+        for (;;) {
+            elt = bench_now();
+            sink = read_sum(A, n, num_iterations);
+            elt = bench_now() - elt;
+            if (elt >= SWEEP_TARGET_TIME/10 || num_iterations >= (1 << 30))
+                break;
+            num_iterations *= 2;
+        }
+        double scaled = num_iterations * (SWEEP_TARGET_TIME/elt);
+        num_iterations = (scaled < 1.0) ? 1 : (scaled > 1e9 ? 1000000000 : (int) scaled);
+
+        elt = bench_now();
+        sink = read_sum(A, n, num_iterations);
+        elt = bench_now() - elt;
+        (void) sink;
+
+        double gbs = 4.0*n*num_iterations/(elt*1e9);
+        fprintf(out, "%ld,%d,%d,%.9lf,%.6lf\n",
+                4L*n, n, num_iterations, elt, gbs);
+        fprintf(stderr, "%12ld %10d %12.3lf\n", 4L*n, num_iterations, gbs);
+    }
+
+    fclose(out);
+    bench_free(A);
+
+    return 0;
 }
 
 
 int main(int argc, char **argv) 
 {
 
-    /* One input argument, value of n */
-    if (argc != 2) {
-        fprintf(stderr, "%s <n>\n", argv[0]);
+    bench_alloc_args(&argc, argv);
+    bench_harness_args(&argc, argv);
+
+    /* value of n, optionally the number of threads for the STREAM kernels */
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "%s <n> [threads]\n", argv[0]);
+        fprintf(stderr, "%s sweep <csv file> [max MB]\n", argv[0]);
+        fprintf(stderr, "without threads: single-threaded read-sum of ints\n");
+        fprintf(stderr, "with threads:    OpenMP copy/scale/add/triad on doubles\n");
+        fprintf(stderr, "sweep:           read-sum from 4 KB to max MB (default 4000)\n");
+        fprintf(stderr, "--alloc=<policy> anywhere selects the allocator (see common/bench_alloc.h)\n");
+        fprintf(stderr, "--format=csv|json and the other flags in common/bench_harness.h control timing\n");
         exit(1);
     }
 
+    if (strcmp(argv[1], "sweep") == 0) {
+        assert(argc >= 3);
+        long max_mb = (argc == 4) ? atol(argv[3]) : 4000;
+        assert(max_mb > 0);
+        assert(max_mb <= 4000);
+        return sweep_bench(argv[2], max_mb*1000000L);
+    }
+    assert(argc <= 3);
+
     int n;
 
     n = atoi(argv[1]);
@@ -40,17 +279,6 @@ int main(int argc, char **argv)
     /* making n a multiple of 4 */
     n = (n/4) * 4;
 
-    int *A;
-    A = (int *) malloc(n * sizeof(int));
-    assert(A != 0);
-
-    int i;
-
-    /* initialize values to be 0, 1, 2, 3 */
-    for (i=0; i<n; i++) {
-        A[i] = (i & 3);
-    }
-
     /* Number of times to run */
     int num_iterations = 10;
     if (n < 100000) {
@@ -61,25 +289,44 @@ int main(int argc, char **argv)
         num_iterations = 100;
     }
 
+    if (argc == 3) {
+        int num_threads = atoi(argv[2]);
+        assert(num_threads > 0);
+        return stream_bench(n, num_threads, num_iterations);
+    }
+
+    int *A;
+    A = (int *) bench_alloc(n * sizeof(int));
+    assert(A != 0);
+
+    int i;
+
+    /* initialize values to be 0, 1, 2, 3 */
+    for (i=0; i<n; i++) {
+        A[i] = (i & 3);
+    }
+
+    /* one repetition is num_iterations passes over A */
     long total_sum = 0;
-    double elt = timer();
-    int iter;
-    for ( iter=0; iter<num_iterations; iter++) {
-        int sum = 0;
-        for (i=0; i<n; i++) {
-            sum += A[i];
-        }
-        total_sum += sum;
+    bench_t b;
+    bench_init(&b, "read_sum", 1);
+    bench_set_work(&b, 4.0*n*num_iterations, 1.0*n*num_iterations);
+    while (bench_next(&b)) {
+        bench_start(&b);
+        total_sum = read_sum(A, n, num_iterations);
+        bench_stop(&b);
     }
-    elt = timer() - elt;
+    double elt = bench_stats(&b).median;
 
     fprintf(stderr, "n: %d, num_iterations: %d, total sum: %ld\n",
             n, num_iterations, total_sum);
-    fprintf(stderr, "Elapsed time: %9.6lf s\n", elt);
+    fprintf(stderr, "Elapsed time (median): %9.6lf s\n", elt);
     fprintf(stderr, "Sustained bandwidth: %9.6lf GB/s\n", 
                     4.0*n*num_iterations/(elt*1e9));
     fprintf(stderr, "sizeof int: %d\n", sizeof(int));
-    free(A);
+    bench_report(&b);
+    bench_destroy(&b);
+    bench_free(A);
 
     return 0;
 }
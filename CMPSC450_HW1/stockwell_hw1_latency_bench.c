@@ -1,36 +1,652 @@
-/* compile the code with gcc stockwell_hw1_latency_bench.c -o hw*/
+/* compile the code with gcc stockwell_hw1_latency_bench.c -lm -o hw*/
+/* add -fopenmp to enable the loaded-latency mode */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
 #include <sys/time.h>
 #include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
 
-static double timer() 
+/* fill A with 0..n-1 and swap some values around */
+static void init_random(int *A, const int n)
 {
+	int i;
+
+	/* initialize values to be i*/
+	for (i=0; i<n; i++) {
+		A[i] = i;
+	}
+
+	/* Swap some values around*/
+	for(i=0; i<2*n; i++)
+	{
+		int j = (int) random()%(n-1);
+		int k = (int) random()%(n-1);
+		int temp = A[j];
+		A[j] = A[k];
+		A[k] = temp;
+	}
+}
+
+/* one indirect load A[A[i]] per element, repeated num_iterations times */
+static long latency_kernel(const int *A, const int n, const int num_iterations)
+{
+	long total_sum = 0;
+	int i, iter;
+	for ( iter=0; iter<num_iterations; iter++) {
+		int sum = 0;
+		for (i=0; i<n; i++) {
+			int j = A[i];
+			int val = (A[j]&3);
+			sum = sum+val;
+		}
+		total_sum += sum;
+	}
+	return total_sum;
+}
+
+/* Pointer chasing: every element is one cache line holding the address
+   of the next line to visit.  The lines form a single random cycle
+   (Sattolo's algorithm), so the walk touches the whole working set before
+   it repeats and each load address depends on the previous load.  Unlike
+   latency_kernel() the hardware can not overlap these misses, so the time
+   per step is the load-to-use latency. */
+#define LINE_SIZE 64
+
+typedef struct line_t
+{
+	struct line_t *next;
+	char pad[LINE_SIZE - sizeof(struct line_t *)];
+} line_t;
+
+static line_t *alloc_lines(const long num_lines)
+{
+	line_t *L = (line_t *) bench_alloc_aligned(num_lines * sizeof(line_t), LINE_SIZE);
+	assert(L != 0);
+	return L;
+}
+
+/* random() only gives 31 bits, combine two calls for large working sets */
+static long random_below(const long bound)
+{
+	unsigned long r = ((unsigned long) random() << 31) | (unsigned long) random();
+	return (long) (r % (unsigned long) bound);
+}
+
+/* link the lines into one random cycle and return the start of the walk */
+static line_t *init_chase(line_t *L, const long num_lines)
+{
+	long *order = (long *) malloc(num_lines * sizeof(long));
+	assert(order != 0);
+
+	long i;
+	for (i=0; i<num_lines; i++) {
+		order[i] = i;
+	}
+
+	/* Sattolo: j < i (never j == i) yields a single cycle of length n */
+	for (i=num_lines-1; i>0; i--) {
+		long j = random_below(i);
+		long temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+
+	for (i=0; i<num_lines; i++) {
+		L[order[i]].next = &L[order[(i+1) % num_lines]];
+	}
+
+	line_t *start = &L[order[0]];
+	free(order);
+	return start;
+}
+
+/* follow the chain for num_steps dependent loads */
+static line_t *chase_kernel(line_t *p, const long num_steps)
+{
+	long step;
+	for (step=0; step<num_steps; step++) {
+		p = p->next;
+	}
+	return p;
+}
+
+/* run a chase of num_steps and return the elapsed time in seconds */
+static double time_chase(line_t *start, const long num_steps)
+{
+	double elt = bench_now();
+	line_t * volatile end = chase_kernel(start, num_steps);
+	elt = bench_now() - elt;
+	(void) end;
+	return elt;
+}
+
+/* Memory-level parallelism: walk K independent chains in lockstep.  Each
+   chain is still a dependent chase, but the K loads of one step are
+   independent of each other, so the core can keep up to K misses in
+   flight.  K is a compile-time constant in every instantiation so the
+   chain pointers stay in registers instead of going through memory. */
+#define MLP_MAX_CHAINS 32
+
+static inline __attribute__((always_inline))
+line_t *chase_multi(line_t **p, const int K, const long num_steps)
+{
+	line_t *q[MLP_MAX_CHAINS];
+	int k;
+	for (k=0; k<K; k++) {
+		q[k] = p[k];
+	}
+
+	long step;
+	for (step=0; step<num_steps; step++) {
+		for (k=0; k<K; k++) {
+			q[k] = q[k]->next;
+		}
+	}
+
+	/* fold the ends together so no chain can be optimized away */
+	line_t *end = q[0];
+	for (k=1; k<K; k++) {
+		if (q[k] < end)
+			end = q[k];
+	}
+	return end;
+}
+
+#define CHASE_CASE(K) case K: end = chase_multi(p, K, num_steps); break;
+
+/* run K chains for num_steps each and return the elapsed time */
+static double time_chase_multi(line_t **p, const int K, const long num_steps)
+{
+	line_t *end = NULL;
+	double elt = bench_now();
+	switch (K) {
+		CHASE_CASE(1)  CHASE_CASE(2)  CHASE_CASE(3)  CHASE_CASE(4)
+		CHASE_CASE(5)  CHASE_CASE(6)  CHASE_CASE(7)  CHASE_CASE(8)
+		CHASE_CASE(9)  CHASE_CASE(10) CHASE_CASE(11) CHASE_CASE(12)
+		CHASE_CASE(13) CHASE_CASE(14) CHASE_CASE(15) CHASE_CASE(16)
+		CHASE_CASE(17) CHASE_CASE(18) CHASE_CASE(19) CHASE_CASE(20)
+		CHASE_CASE(21) CHASE_CASE(22) CHASE_CASE(23) CHASE_CASE(24)
+		CHASE_CASE(25) CHASE_CASE(26) CHASE_CASE(27) CHASE_CASE(28)
+		CHASE_CASE(29) CHASE_CASE(30) CHASE_CASE(31) CHASE_CASE(32)
+		default: assert(0);
+	}
+	elt = bench_now() - elt;
+	line_t * volatile sink = end;
+	(void) sink;
+	return elt;
+}
+
+/* run latency_kernel() for num_iterations and return the elapsed time */
+static double time_latency(const int *A, const int n, const long num_iterations)
+{
+	double elt = bench_now();
+	volatile long sink = latency_kernel(A, n, (int) num_iterations);
+	elt = bench_now() - elt;
+	(void) sink;
+	return elt;
+}
+
+/* Working-set sweep: grow the array geometrically from min_bytes to
+   max_bytes and write size vs. ns per access to a CSV file, both for the
+   indirect A[A[i]] kernel and for the dependent pointer chase.  The number
+   of iterations is calibrated per point so each kernel runs for roughly
+   target_time seconds. */
+#define SWEEP_MIN_BYTES     4096L
+#define SWEEP_STEPS_PER_2X  4
+#define SWEEP_TARGET_TIME   0.2
+
+/* double the repetitions until the run is measurable, then scale to the
+   target time */
+#define CALIBRATE(reps, elt, run) \
+	do { \
+		(reps) = 1; \
+		for (;;) { \
+			(elt) = (run); \
+			if ((elt) >= SWEEP_TARGET_TIME/10 || (reps) >= (1L << 40)) \
+				break; \
+			(reps) *= 2; \
+		} \
+		double scaled = (reps) * (SWEEP_TARGET_TIME/(elt)); \
+		(reps) = (scaled < 1.0) ? 1 : (long) scaled; \
+	} while (0)
+
+static int sweep_bench(const char *filename, const long max_bytes)
+{
+	FILE *out = fopen(filename, "w");
+	if (out == NULL) {
+		fprintf(stderr, "could not open %s for writing\n", filename);
+		exit(1);
+	}
+
+	/* the chase lines and the int array share one buffer */
+	line_t *L = alloc_lines(max_bytes / LINE_SIZE);
+	int *A = (int *) L;
+
+	fprintf(out, "bytes,n,iterations,seconds,ns_per_access,chase_steps,chase_seconds,chase_ns_per_access\n");
+	fprintf(stderr, "%12s %10s %12s %12s\n", "bytes", "iterations", "ns/access", "chase ns");
+
+	int step;
+	long last_lines = 0;
+	for (step=0; ; step++) {
+		long bytes = (long) (SWEEP_MIN_BYTES * pow(2.0, (double) step/SWEEP_STEPS_PER_2X));
+		if (bytes > max_bytes)
+			break;
+		long num_lines = bytes / LINE_SIZE;
+		if (num_lines == last_lines)
+			continue;
+		last_lines = num_lines;
+		bytes = num_lines * LINE_SIZE;
+		int n = (int) (bytes / sizeof(int));
+
+		init_random(A, n);
+
+		long num_iterations;
+		double elt;
+		CALIBRATE(num_iterations, elt, time_latency(A, n, num_iterations));
+		assert(num_iterations <= 1000000000);
+		elt = time_latency(A, n, num_iterations);
+		double ns = elt*1e9/((double) n*num_iterations);
+
+		line_t *start = init_chase(L, num_lines);
+
+		long num_steps;
+		double chase_elt;
+		CALIBRATE(num_steps, chase_elt, time_chase(start, num_steps));
+		chase_elt = time_chase(start, num_steps);
+		double chase_ns = chase_elt*1e9/num_steps;
+
+		fprintf(out, "%ld,%d,%ld,%.9lf,%.6lf,%ld,%.9lf,%.6lf\n",
+				bytes, n, num_iterations, elt, ns, num_steps, chase_elt, chase_ns);
+		fprintf(stderr, "%12ld %10ld %12.3lf %12.3lf\n",
+				bytes, num_iterations, ns, chase_ns);
+	}
+
+	fclose(out);
+	bench_free(L);
+
+	return 0;
+}
+
+/* single working set, dependent pointer chase, reported in ns per access */
+static int chase_bench(const long bytes)
+{
+	long num_lines = bytes / LINE_SIZE;
+	assert(num_lines > 1);
+
+	line_t *L = alloc_lines(num_lines);
+	line_t *start = init_chase(L, num_lines);
+
+	/* walk the whole cycle a few times, at least 10M steps */
+	long num_steps = num_lines * 4;
+	if (num_steps < 10000000L)
+		num_steps = 10000000L;
+
+	/* the warmup runs fault in the pages and fill the caches/TLB */
+	bench_t b;
+	bench_init(&b, "chase", 5);
+	line_t * volatile end;
+	while (bench_next(&b))
+	{
+		bench_start(&b);
+		end = chase_kernel(start, num_steps);
+		bench_stop(&b);
+	}
+	(void) end;
+	bench_stats_t st = bench_stats(&b);
 
-	struct timeval tp;
-	gettimeofday(&tp, NULL);
-	return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
+	fprintf(stderr, "bytes: %ld, lines: %ld, steps: %ld\n",
+			num_lines*LINE_SIZE, num_lines, num_steps);
+	fprintf(stderr, "Elapsed time (median): %9.6lf s\n", st.median);
+	fprintf(stderr, "Latency: %9.3lf ns/access (min %9.3lf)\n",
+			st.median*1e9/num_steps, st.min*1e9/num_steps);
+	bench_report(&b);
+	bench_destroy(&b);
+	bench_free(L);
 
-	/* The code below is for another high resolution timer */
-	/* I'm using gettimeofday because it's more portable */
-	/*
-	   struct timespec tp;
-	   clock_gettime(CLOCK_MONOTONIC, &tp);
-	   return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-	   */
+	return 0;
+}
+
+
+/* MLP sweep: K = 1..max_chains chains spread evenly around one random
+   cycle, reported as effective ns per access and speedup over K = 1 */
+static int mlp_bench(const long bytes, const int max_chains)
+{
+	long num_lines = bytes / LINE_SIZE;
+	assert(num_lines >= max_chains);
+
+	line_t *L = alloc_lines(num_lines);
+	line_t *start = init_chase(L, num_lines);
+
+	line_t *p[MLP_MAX_CHAINS];
+	int k;
+
+	/* warmup lap */
+	time_chase(start, num_lines);
+
+	fprintf(stderr, "bytes: %ld, lines: %ld\n", num_lines*LINE_SIZE, num_lines);
+	fprintf(stderr, "%6s %12s %12s %10s\n", "chains", "steps/chain", "ns/access", "speedup");
+
+	/* keep the total number of loads per point constant */
+	long total_loads = num_lines * 4;
+	if (total_loads < 10000000L)
+		total_loads = 10000000L;
+
+	double base_ns = 0.0;
+	int K;
+	for (K=1; K<=max_chains; K++) {
+		/* the K chains start num_lines/K apart on the same cycle, so they
+		   never meet; the line chain k reaches was visited by chain k-1
+		   num_lines/K rounds earlier, and the K chains touched about
+		   num_lines other lines in between, so every K sees the whole
+		   working set */
+		long spacing = num_lines / K;
+		p[0] = start;
+		for (k=1; k<K; k++) {
+			p[k] = chase_kernel(p[k-1], spacing);
+		}
+
+		long num_steps = total_loads / K;
+		double elt_min = 1e30;
+		int r, repeats = 3;
+		for (r=0; r<repeats; r++) {
+			double elt = time_chase_multi(p, K, num_steps);
+			if (elt < elt_min)
+				elt_min = elt;
+		}
+		double ns = elt_min*1e9/((double) num_steps*K);
+		if (K == 1)
+			base_ns = ns;
+		fprintf(stderr, "%6d %12ld %12.3lf %10.2lf\n", K, num_steps, ns, base_ns/ns);
+	}
+
+	bench_free(L);
+
+	return 0;
 }
 
 
+#ifdef _OPENMP
+/* Loaded latency: thread 0 chases pointers while the other threads inject
+   memory traffic with a read, write or triad kernel.  The loaders work in
+   chunks and spin for a delay between chunks; sweeping the delay from
+   large to zero traces latency as a function of injected bandwidth, the
+   same way Intel's MLC does.  Given a file name the curve is also written
+   there as CSV, one row per delay; the unloaded point has delay -1. */
+#define LOADED_CHUNK       1024
+#define LOADED_MAX_DELAY   (1 << 14)
+/* seconds the chaser waits for the loaders to reach speed */
+#define LOADED_WARMUP      0.001
+
+enum { KERNEL_READ, KERNEL_WRITE, KERNEL_TRIAD };
+
+static const char *kernel_names[] = { "read", "write", "triad" };
+
+/* doubles moved per element, write-allocate not counted (as in STREAM) */
+static const int kernel_words[] = { 1, 1, 3 };
+
+/* stream over [0, n) of the loader's own arrays until *stop is set,
+   returning the number of elements processed while *timing was set */
+static long loader_kernel(const int kernel, double *a, const double *b,
+		const double *c, const long n, const int delay, int *timing,
+		int *stop, double *result)
+{
+	long done = 0;
+	long i = 0;
+	double sum = 0.0;
+	const double scalar = 0.4;
+
+	for (;;) {
+		int stopped;
+#pragma omp atomic read
+		stopped = *stop;
+		if (stopped)
+			break;
+
+		long end = i + LOADED_CHUNK;
+		long j;
+		if (kernel == KERNEL_READ) {
+			for (j=i; j<end; j++)
+				sum += a[j];
+		} else if (kernel == KERNEL_WRITE) {
+			for (j=i; j<end; j++)
+				a[j] = scalar;
+		} else {
+			for (j=i; j<end; j++)
+				a[j] = b[j] + scalar*c[j];
+		}
+		int timed;
+#pragma omp atomic read
+		timed = *timing;
+		if (timed)
+			done += LOADED_CHUNK;
+		i = (end >= n) ? 0 : end;
+
+		volatile int d;
+		for (d=0; d<delay; d++)
+			;
+	}
+
+	*result = sum;
+	return done;
+}
+
+static int loaded_bench(const long bytes, const int num_loaders,
+		const int kernel, const long loader_bytes, const char *filename)
+{
+	FILE *out = NULL;
+	if (filename != NULL) {
+		out = fopen(filename, "w");
+		if (out == NULL) {
+			fprintf(stderr, "could not open %s for writing\n", filename);
+			exit(1);
+		}
+		fprintf(out, "bytes,kernel,loaders,delay,loader_gbs,steps,seconds,ns_per_access\n");
+	}
+
+	long num_lines = bytes / LINE_SIZE;
+	assert(num_lines > 1);
+
+	line_t *L = alloc_lines(num_lines);
+	line_t *start = init_chase(L, num_lines);
+
+	/* each loader streams over its own slice, rounded to whole chunks */
+	long slice = (loader_bytes / sizeof(double)) / LOADED_CHUNK * LOADED_CHUNK;
+	assert(slice > 0);
+	double *a = (double *) bench_alloc(num_loaders * slice * sizeof(double));
+	double *b = (double *) bench_alloc(num_loaders * slice * sizeof(double));
+	double *c = (double *) bench_alloc(num_loaders * slice * sizeof(double));
+	assert(a != 0 && b != 0 && c != 0);
+
+	long *done = (long *) calloc(num_loaders + 1, sizeof(long));
+	double *results = (double *) calloc(num_loaders + 1, sizeof(double));
+	assert(done != 0 && results != 0);
+
+	omp_set_dynamic(0);
+
+	/* first touch by the thread that will stream the slice */
+#pragma omp parallel num_threads(num_loaders + 1)
+{
+	/* this team isn't the default size, so --bind has to be applied here */
+	bench_topo_pin();
+	int tid = omp_get_thread_num();
+	if (tid > 0) {
+		long base = (tid-1) * slice;
+		long i;
+		for (i=0; i<slice; i++) {
+			a[base+i] = 1.0;
+			b[base+i] = 2.0;
+			c[base+i] = 0.5;
+		}
+	}
+}
+
+	/* warmup lap */
+	time_chase(start, num_lines);
+
+	long num_steps = num_lines * 2;
+	if (num_steps < 5000000L)
+		num_steps = 5000000L;
+
+	fprintf(stderr, "bytes: %ld, lines: %ld, steps: %ld\n",
+			num_lines*LINE_SIZE, num_lines, num_steps);
+	fprintf(stderr, "loaders: %d, kernel: %s, MB per loader: %.1lf\n",
+			num_loaders, kernel_names[kernel], 8.0*slice/1e6);
+	fprintf(stderr, "%8s %12s %12s\n", "delay", "GB/s", "ns/access");
+
+	/* the unloaded point first, then from lightest to heaviest load */
+	double elt = time_chase(start, num_steps);
+	fprintf(stderr, "%8s %12.3lf %12.3lf\n", "idle", 0.0, elt*1e9/num_steps);
+	if (out != NULL)
+		fprintf(out, "%ld,%s,%d,%d,%.6lf,%ld,%.9lf,%.4lf\n", num_lines*LINE_SIZE,
+				kernel_names[kernel], num_loaders, -1, 0.0, num_steps, elt, elt*1e9/num_steps);
+
+	int delay;
+	for (delay=LOADED_MAX_DELAY; delay>=0; delay = (delay > 0) ? delay/4 : -1) {
+
+		int timing = 0, stop = 0;
+		double loaded_elt = 0.0;
+
+#pragma omp parallel num_threads(num_loaders + 1)
+{
+		bench_topo_pin();
+		int tid = omp_get_thread_num();
+
+		/* everyone starts together, then the chaser gives the loaders
+		   LOADED_WARMUP to get going before it starts the clock */
+#pragma omp barrier
+		if (tid == 0) {
+			double t0 = bench_now();
+			while (bench_now() - t0 < LOADED_WARMUP)
+				;
+#pragma omp atomic write
+			timing = 1;
+			loaded_elt = time_chase(start, num_steps);
+#pragma omp atomic write
+			stop = 1;
+		} else {
+			long base = (tid-1) * slice;
+			done[tid] = loader_kernel(kernel, &a[base], &b[base], &c[base],
+					slice, delay, &timing, &stop, &results[tid]);
+		}
+}
+
+		/* the loaders overrun the chase by at most one chunk each */
+		long total = 0;
+		int t;
+		for (t=1; t<=num_loaders; t++) {
+			total += done[t];
+		}
+		double gbs = 8.0*kernel_words[kernel]*total/(loaded_elt*1e9);
+		fprintf(stderr, "%8d %12.3lf %12.3lf\n", delay, gbs, loaded_elt*1e9/num_steps);
+		if (out != NULL)
+			fprintf(out, "%ld,%s,%d,%d,%.6lf,%ld,%.9lf,%.4lf\n", num_lines*LINE_SIZE,
+					kernel_names[kernel], num_loaders, delay, gbs, num_steps,
+					loaded_elt, loaded_elt*1e9/num_steps);
+	}
+
+	if (out != NULL)
+		fclose(out);
+
+	bench_free(L);
+	bench_free(a);
+	bench_free(b);
+	bench_free(c);
+	free(done);
+	free(results);
+
+	return 0;
+}
+#endif
+
+
 int main(int argc, char **argv) 
 {
 
 
+	bench_alloc_args(&argc, argv);
+	bench_harness_args(&argc, argv);
+
 	/* One input argument, value of n */
-	if (argc != 2) {
+	if (argc < 2 || argc > 7) {
 		fprintf(stderr, "%s <n>\n", argv[0]);
+		fprintf(stderr, "%s chase <KB>\n", argv[0]);
+		fprintf(stderr, "%s mlp <KB> [max chains]\n", argv[0]);
+		fprintf(stderr, "%s loaded <KB> <loader threads> <read|write|triad> [MB per loader] [csv file]\n", argv[0]);
+		fprintf(stderr, "%s sweep <csv file> [max MB]\n", argv[0]);
+		fprintf(stderr, "chase:  dependent pointer chase over a single random cycle\n");
+		fprintf(stderr, "mlp:    1..max chains (default 32) chased in lockstep\n");
+		fprintf(stderr, "loaded: chase latency vs bandwidth injected by other threads\n");
+		fprintf(stderr, "        (requires -fopenmp, default 100 MB per loader)\n");
+		fprintf(stderr, "        the curve also goes to csv file, if given\n");
+		fprintf(stderr, "--alloc=<policy> anywhere selects the allocator (see common/bench_alloc.h)\n");
+		fprintf(stderr, "--format=csv|json and the other flags in common/bench_harness.h control timing\n");
+		fprintf(stderr, "sweep: 4 KB to max MB (default 4000), ns per access\n");
+		exit(1);
+	}
+
+	if (strcmp(argv[1], "chase") == 0) {
+		assert(argc == 3);
+		long kb = atol(argv[2]);
+		assert(kb > 0);
+		assert(kb <= 4000000);
+		return chase_bench(kb*1024L);
+	}
+
+	if (strcmp(argv[1], "mlp") == 0) {
+		assert(argc >= 3);
+		long kb = atol(argv[2]);
+		int max_chains = (argc == 4) ? atoi(argv[3]) : MLP_MAX_CHAINS;
+		assert(kb > 0);
+		assert(kb <= 4000000);
+		assert(max_chains > 0);
+		assert(max_chains <= MLP_MAX_CHAINS);
+		return mlp_bench(kb*1024L, max_chains);
+	}
+
+	if (strcmp(argv[1], "loaded") == 0) {
+		assert(argc >= 5);
+#ifdef _OPENMP
+		long kb = atol(argv[2]);
+		int num_loaders = atoi(argv[3]);
+		long mb = (argc >= 6) ? atol(argv[5]) : 100;
+		const char *csv = (argc == 7) ? argv[6] : NULL;
+		int kernel;
+		if (strcmp(argv[4], "read") == 0)
+			kernel = KERNEL_READ;
+		else if (strcmp(argv[4], "write") == 0)
+			kernel = KERNEL_WRITE;
+		else if (strcmp(argv[4], "triad") == 0)
+			kernel = KERNEL_TRIAD;
+		else {
+			fprintf(stderr, "unknown kernel %s\n", argv[4]);
+			exit(1);
+		}
+		assert(kb > 0);
+		assert(kb <= 4000000);
+		assert(num_loaders > 0);
+		assert(mb > 0);
+		return loaded_bench(kb*1024L, num_loaders, kernel, mb*1000000L, csv);
+#else
+		fprintf(stderr, "loaded mode needs OpenMP, recompile with -fopenmp\n");
 		exit(1);
+#endif
+	}
+
+	if (strcmp(argv[1], "sweep") == 0) {
+		assert(argc >= 3);
+		long max_mb = (argc == 4) ? atol(argv[3]) : 4000;
+		assert(max_mb > 0);
+		assert(max_mb <= 4000);
+		return sweep_bench(argv[2], max_mb*1000000L);
 	}
+	assert(argc == 2);
 
 	int n;
 
@@ -45,25 +661,10 @@ int main(int argc, char **argv)
 	n = (n/4) * 4;
 
 	int *A;
-	A = (int *) malloc(n * sizeof(int));
+	A = (int *) bench_alloc(n * sizeof(int));
 	assert(A != 0);
 
-	int i;
-
-	/* initialize values to be i*/
-	for (i=0; i<n; i++) {
-		A[i] = i;
-	}
-
-	/* Swap some values around*/
-	for(i=0; i<2*n; i++)
-	{
-		int j = (int) random()%(n-1);
-		int k = (int) random()%(n-1);
-		int temp = A[j];
-		A[j] = A[k];
-		A[k] = temp;
-	}
+	init_random(A, n);
 
 	/* Number of times to run */
 	int num_iterations = 10;
@@ -77,31 +678,24 @@ int main(int argc, char **argv)
 
 	long total_sum = 0;
 
-	double elt_sum = 0, elt_avg = 0;
-	int k, repeats = 20;
-	for(k = 0; k<repeats; k++)
+	double elt_avg = 0;
+	bench_t b;
+	bench_init(&b, "latency", 20);
+	while (bench_next(&b))
 	{
-		double elt = timer();
-		int iter;
-		for ( iter=0; iter<num_iterations; iter++) {
-			int sum = 0;
-			for (i=0; i<n; i++) {
-				int j = A[i];
-				int val = (A[j]&3);
-				sum = sum+val;
-			}
-			total_sum += sum;
-		}
-		elt = timer() - elt;
-		elt_sum+=elt;
+		bench_start(&b);
+		total_sum += latency_kernel(A, n, num_iterations);
+		bench_stop(&b);
 	}
-	elt_avg = elt_sum/repeats;
-	// fprintf(stderr, "n: %d, num_iterations: %d, total sum: %ld\n",n, num_iterations, total_sum);
+	elt_avg = bench_mean(&b);
+	fprintf(stderr, "n: %d, num_iterations: %d, total sum: %ld\n",n, num_iterations, total_sum);
 	fprintf(stderr, "Elapsed time: %9.6lf s\n", elt_avg);
 	fprintf(stderr, "Sustained latency: %9.6lf mS/MR\n", 
 			(elt_avg)/n*num_iterations);
 	//fprintf(stderr, "sizeof int: %d\n", sizeof(int));
-	free(A);
+	bench_report(&b);
+	bench_destroy(&b);
+	bench_free(A);
 
 	return 0;
 }
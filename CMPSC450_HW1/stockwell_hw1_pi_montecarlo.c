@@ -0,0 +1,101 @@
+/* compile the code with gcc -O3 -fopenmp stockwell_hw1_pi_montecarlo.c -lm -o hw*/
+/* Monte Carlo estimate of pi next to the integration in stockwell_hw1_pi_omp.c:
+   the fraction of random points in the unit square inside the quarter circle.
+   Sample i is made from Philox counter i, so the estimate is the same for
+   any number of threads. */
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <math.h>
+#include "../common/bench_harness.h"
+#include "philox.h"
+
+/* samples generated per simd loop */
+#define BATCH 1024
+
+/* hits among samples [lo, hi) of the stream with the given seed */
+static uint64_t count_hits(uint64_t lo, uint64_t hi, uint64_t seed)
+{
+	const uint32_t key[2] = { (uint32_t) seed, (uint32_t) (seed >> 32) };
+	uint64_t hits = 0;
+	uint32_t r0[BATCH], r1[BATCH], r2[BATCH], r3[BATCH];
+	uint64_t start;
+	for (start=lo; start<hi; start+=BATCH)
+	{
+		int len = (hi - start < BATCH) ? (int) (hi - start) : BATCH;
+		philox4x32_batch(start, len, key, r0, r1, r2, r3);
+		uint64_t batch_hits = 0;
+		int k;
+		#pragma omp simd reduction(+:batch_hits)
+		for (k=0; k<len; k++)
+		{
+			double x = philox_uniform(r0[k], r1[k]);
+			double y = philox_uniform(r2[k], r3[k]);
+			batch_hits += (x*x + y*y < 1.0);
+		}
+		hits += batch_hits;
+	}
+	return hits;
+}
+
+int main(int argc, char **argv)
+{
+	bench_harness_args(&argc, argv);
+
+	if (argc < 3 || argc > 4) {
+		fprintf(stderr, "%s <samples> <threads> [seed]\n", argv[0]);
+		fprintf(stderr, "--bind=compact|scatter|core pins the default OpenMP team, not nested teams (see common/bench_topo.h)\n");
+		exit(1);
+	}
+
+	uint64_t n = strtoull(argv[1], NULL, 10);
+	int t = atoi(argv[2]);
+	uint64_t seed = (argc > 3) ? strtoull(argv[3], NULL, 10) : 450;
+	assert(n > 0);
+	assert(t > 0);
+
+	if (philox_selftest() != 0) {
+		fprintf(stderr, "ERROR: philox4x32 doesn't match the known answers\n");
+		exit(2);
+	}
+
+	// Turn off dynamic teaming
+	omp_set_dynamic(0);
+	omp_set_num_threads(t);
+
+	uint64_t hits = 0;
+	bench_t b;
+	bench_init(&b, "pi_montecarlo", 1);
+	/* 10 rounds of 2 multiplies per sample plus the test, roughly */
+	bench_set_work(&b, 0.0, 5.0*n);
+	while (bench_next(&b))
+	{
+		hits = 0;
+		bench_start(&b);
+		/* integer counts add up exactly in any order */
+		#pragma omp parallel reduction(+:hits)
+		{
+			uint64_t nt = omp_get_num_threads();
+			uint64_t tid = omp_get_thread_num();
+			hits += count_hits(n/nt*tid + (tid < n%nt ? tid : n%nt),
+			                   n/nt*(tid+1) + (tid+1 < n%nt ? tid+1 : n%nt), seed);
+		}
+		bench_stop(&b);
+	}
+
+	double elt = bench_stats(&b).median;
+	double p = (double) hits / n;
+	double approx_pi = 4.0*p;
+
+	fprintf(stderr, "samples: %llu, hits: %llu, approx_pi: %.10lf\n",
+			(unsigned long long) n, (unsigned long long) hits, approx_pi);
+	fprintf(stderr, "Error: %.3e, standard error: %.3e\n", approx_pi - M_PI, 4.0*sqrt(p*(1-p)/n));
+	fprintf(stderr, "Elapsed time: %9.6lf s\n", elt);
+	fprintf(stderr, "Sample rate: %9.3lf Gsamples/s\n", n/elt/1e9);
+	bench_report(&b);
+	bench_destroy(&b);
+
+	return 0;
+}
@@ -5,30 +5,32 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <time.h>
+#include <string.h>
+#include <math.h>
+#include "../common/bench_harness.h"
+#include "integrate.h"
 
-static double timer() 
+static inline double pi_integrand(double x)
 {
-
-	struct timeval tp;
-	gettimeofday(&tp, NULL);
-	return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-	/* The code below is for another high resolution timer */
-	/* I'm using gettimeofday because it's more portable */
-	/*
-	   struct timespec tp;
-	   clock_gettime(CLOCK_MONOTONIC, &tp);
-	   return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-	   */
+	return 4.0/(1.0+x*x);
 }
 
+INTEGRATE_DEFINE(pi, pi_integrand)
+
 
 int main(int argc, char **argv) 
 {
 
-	/* One input argument, value of n */
-	if (argc != 3) {
-		fprintf(stderr, "%s <n> <threads>\n", argv[0]);
+	bench_harness_args(&argc, argv);
+
+	/* value of n, threads, optionally the rule and the accumulation */
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr, "%s <n> <threads> [loop|midpoint|simpson|gauss|adaptive] [plain|kahan|pairwise]\n", argv[0]);
+		fprintf(stderr, "loop:     the original midpoint loop (default)\n");
+		fprintf(stderr, "midpoint, simpson, gauss: n intervals with integrate.h (gauss: %d points each)\n",
+				INTEGRATE_GAUSS_ORDER);
+		fprintf(stderr, "adaptive: adaptive Simpson with tasks to an error of 1/n\n");
+		fprintf(stderr, "--bind=compact|scatter|core pins the default OpenMP team, not nested teams (see common/bench_topo.h)\n");
 		exit(1);
 	}
 
@@ -40,36 +42,77 @@ int main(int argc, char **argv)
 	assert(n > 0);
 	assert(n <= 1000000000);// 1,000,000,000
 
+	/* -1 is the original loop */
+	int rule = -1, accum = INTEGRATE_PLAIN;
+	if (argc > 3 && strcmp(argv[3], "loop") != 0) {
+		for (rule=0; rule<INTEGRATE_NUM_RULES; rule++) {
+			if (strcmp(argv[3], integrate_rule_names[rule]) == 0)
+				break;
+		}
+		if (rule == INTEGRATE_NUM_RULES) {
+			fprintf(stderr, "unknown rule %s\n", argv[3]);
+			exit(1);
+		}
+	}
+	if (argc > 4) {
+		for (accum=0; accum<INTEGRATE_NUM_ACCUMS; accum++) {
+			if (strcmp(argv[4], integrate_accum_names[accum]) == 0)
+				break;
+		}
+		if (accum == INTEGRATE_NUM_ACCUMS) {
+			fprintf(stderr, "unknown accumulation %s\n", argv[4]);
+			exit(1);
+		}
+	}
+
 	double delta_x = 1.0/n;
 
 	long total_sum = 0;
 	double sum = 0.0;
-	double x = 0.0;
+	double approx_pi = 0.0;
 	int i = 0;
 	// Number of threads
 	omp_set_num_threads(t);
 	int tid; 
 
-	double elt = timer();
-	#pragma omp parallel for private(i) reduction(+:sum)
-	for(i=0; i<n; i++)
+	bench_t b;
+	char name[64];
+	snprintf(name, sizeof(name), "pi_%s", (rule < 0) ? "loop" : integrate_rule_names[rule]);
+	bench_init(&b, name, 1);
+	bench_set_work(&b, 0.0, 6.0*n);
+	while (bench_next(&b))
 	{
-		x = (i+0.5) * delta_x;
-		sum = sum + 4.0/(1.0+x*x);
+		sum = 0.0;
+		bench_start(&b);
+		if (rule < 0) {
+			/* x used to be shared by all the threads */
+			#pragma omp parallel for private(i) reduction(+:sum)
+			for(i=0; i<n; i++)
+			{
+				double x = (i+0.5) * delta_x;
+				sum = sum + 4.0/(1.0+x*x);
+			}
+			approx_pi = sum*delta_x;
+		} else {
+			approx_pi = pi_integrate(rule, 0.0, 1.0, n, accum);
+			sum = approx_pi/delta_x;
+		}
+		bench_stop(&b);
 	}
 
 	//---------------------------------------------- OLD code start
 
-	elt = timer() - elt;
-	double approx_pi = sum*delta_x;
-
+	double elt = bench_stats(&b).median;
 	fprintf(stderr, "n: %d, approx_pi: %.10lf, total sum: %lf\n",
 			n, approx_pi, sum);
+	fprintf(stderr, "Error: %.3e\n", approx_pi - M_PI);
 	fprintf(stderr, "Elapsed time: %9.6lf s\n", elt);
 	// (num_threads*flops_per_thread)/time_taken_in_seconds
 	long double flops = ((n/t)/1e9/elt)*6;
 
 	fprintf(stderr, "GFlops rate: %11.6Lf GFlops\n", flops);
+	bench_report(&b);
+	bench_destroy(&b);
 
 	return 0;
 }
@@ -1,34 +1,139 @@
 /* compile the code with gcc -fopenmp stockwell_hw1_prefix_sums.c -lm -o hw*/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <omp.h>
 #include <assert.h>
 #include <stdint.h>
 #include <math.h>
+#include "../common/bench_harness.h"
+#include "prefix_scan.h"
+#include "scan_ops.h"
 
 void printArray(int32_t *A, int length);
 
-static double timer() 
+enum { ALG_BLOCKED, ALG_LOOKBACK, ALG_BLELLOCH, ALG_SEGMENTED, ALG_FILTER, ALG_PARTITION, NUM_ALGS };
+
+static const char *alg_names[NUM_ALGS] = {
+	"blocked", "lookback", "blelloch", "segmented", "filter", "partition"
+};
+
+/* segment length for the segmented scan */
+#define SEGMENT_LENGTH 1000
+
+/* predicate for filter and partition */
+#define is_odd(p) ((*(p)) & 1)
+
+/* elements of the untimed int64 and double checks */
+#define WIDE_CHECK_MAX (1L << 22)
+
+/* The timed runs only scan int32.  NAME_check runs the blocked,
+ * look-back and segmented scans of the TYPE instantiation once on VALUE(i),
+ * which for int64 overflows int32 after one element, and compares them
+ * with a serial scan; returns the name of the first one that's wrong, or
+ * NULL. */
+#define WIDE_CHECK_DEFINE(TYPE, NAME, VALUE) \
+static const char *NAME##_check(long n, int mode) \
+{ \
+	TYPE *in = malloc(sizeof(TYPE) * n); \
+	TYPE *out = malloc(sizeof(TYPE) * n); \
+	unsigned char *heads = malloc(n); \
+	assert(in != 0 && out != 0 && heads != 0); \
+	const char *wrong = NULL; \
+	long i; \
+	int k; \
+	for(i = 0; i<n; i++) \
+	{ \
+		in[i] = VALUE(i); \
+		heads[i] = (i % SEGMENT_LENGTH == 0); \
+	} \
+	for(k = 0; k<3 && wrong == NULL; k++) \
+	{ \
+		if (k == 0) \
+			NAME##_blocked(in, out, n, mode); \
+		else if (k == 1) \
+			NAME##_lookback(in, out, n, mode); \
+		else \
+			NAME##_segmented(in, heads, out, n, mode); \
+		TYPE run = 0; \
+		for(i = 0; i<n; i++) \
+		{ \
+			if (k == 2 && heads[i]) \
+				run = 0; \
+			if (mode == SCAN_INCLUSIVE) \
+				run += in[i]; \
+			if (out[i] != run) { \
+				wrong = (k == 0) ? "blocked" : (k == 1) ? "lookback" : "segmented"; \
+				break; \
+			} \
+			if (mode == SCAN_EXCLUSIVE) \
+				run += in[i]; \
+		} \
+	} \
+	free(in); \
+	free(out); \
+	free(heads); \
+	return wrong; \
+}
+
+/* sums of multiples of 0.25 stay exact in double, in any order */
+#define WIDE_I64(i) (((int64_t) ((i) & 3) << 32) + ((i) & 3))
+#define WIDE_F64(i) (((i) & 3) + 0.25)
+
+WIDE_CHECK_DEFINE(int64_t, scan_i64, WIDE_I64)
+WIDE_CHECK_DEFINE(double, scan_f64, WIDE_F64)
+
+/* exclusive scan in place; n must be a power of two */
+static void blelloch_scan(int32_t *A, int n)
 {
+	int i;
+	int j;
+	// Upsweep
+	for(i = 0; i<=(int)(log(n-1)/log(2.0)); i++)
+	{
+		int exp = (int) pow(2.0, (double)i+1);
+		int expd = (int) pow(2.0, (double)i);
+		#pragma omp parallel for
+		for(j = 0; j<n; j=j+exp)
+		{
+			A[j+exp-1] = A[j+expd-1] + A[j+exp-1];
+		}
+	}
+	// Set the last index to 0
+	//  printArray(A, n);
+	A[n-1] = 0;
 
-	struct timeval tp;
-	gettimeofday(&tp, NULL);
-	return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-	/* The code below is for another high resolution timer */
-	/* I'm using gettimeofday because it's more portable */
-	/*
-	   struct timespec tp;
-	   clock_gettime(CLOCK_MONOTONIC, &tp);
-	   return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-	   */
+	// Downsweep
+	for(i = (int)(log(n-1)/log(2.0));i>=0; i--)
+	{
+		int exp = (int) pow(2.0, (double)i+1);
+		int expd = (int) pow(2.0, (double)i);
+		#pragma omp parallel for 
+		for(j = 0; j<n; j=j+exp)
+		{
+			int32_t t = A[j+expd-1]; // first saved
+			A[j+expd-1] = A[j+exp-1]; // second stored in first
+			A[j+exp-1] = A[j+exp-1]+t; // stored in second
+		}
+	}
 }
 
 int main(int argc, char **argv)
 {
-	if(argc<3)
+	bench_harness_args(&argc, argv);
+	scan_isa_args(&argc, argv);
+
+	if(argc<3 || argc>5)
 	{
-		fprintf(stderr, "Needs <n> <threads>\n");
+		fprintf(stderr, "Needs <n> <threads> [alg] [exclusive|inclusive]\n");
+		fprintf(stderr, "blocked:   three-phase blocked scan in one parallel region (default)\n");
+		fprintf(stderr, "lookback:  single-pass scan with decoupled look-back over tiles\n");
+		fprintf(stderr, "blelloch:  up-sweep/down-sweep, exclusive only, n a power of two\n");
+		fprintf(stderr, "segmented: blocked scan restarting every %d elements\n", SEGMENT_LENGTH);
+		fprintf(stderr, "filter:    parallel compaction of the odd elements\n");
+		fprintf(stderr, "partition: parallel stable partition, odd elements first\n");
+		fprintf(stderr, "--scan-isa=scalar|avx2|avx512 picks the block scan kernel (default: best supported)\n");
+		fprintf(stderr, "--bind=compact|scatter|core pins the default OpenMP team, not nested teams (see common/bench_topo.h)\n");
 		exit(1);
 	}
 
@@ -38,62 +143,157 @@ int main(int argc, char **argv)
 	int n, threads;
 	n = atoi(argv[1]);
 	threads = atoi(argv[2]);
+	assert(n > 0);
+	/* the int32 sums reach about 1.5 n */
+	assert(n <= 1400000000);
+	assert(threads > 0);
 
-	int *A = malloc(sizeof(int32_t) * n);
+	const char *alg = (argc > 3) ? argv[3] : "blocked";
+	int mode = SCAN_EXCLUSIVE;
+	if (argc > 4 && strcmp(argv[4], "inclusive") == 0)
+		mode = SCAN_INCLUSIVE;
+	else if (argc > 4 && strcmp(argv[4], "exclusive") != 0) {
+		fprintf(stderr, "unknown scan %s, use exclusive or inclusive\n", argv[4]);
+		exit(1);
+	}
+
+	int alg_type;
+	for (alg_type=0; alg_type<NUM_ALGS; alg_type++) {
+		if (strcmp(alg, alg_names[alg_type]) == 0)
+			break;
+	}
+	if (alg_type == NUM_ALGS) {
+		fprintf(stderr, "unknown algorithm %s\n", alg);
+		exit(1);
+	}
+	if (alg_type == ALG_BLELLOCH && (mode != SCAN_EXCLUSIVE || (n & (n-1)) != 0)) {
+		fprintf(stderr, "blelloch only computes exclusive scans of a power of two elements\n");
+		exit(1);
+	}
+
+	int32_t *A = malloc(sizeof(int32_t) * n);
+	int32_t *B = malloc(sizeof(int32_t) * n);
+	unsigned char *heads = malloc(n);
+	assert(A != 0);
+	assert(B != 0);
+	assert(heads != 0);
 
 	omp_set_num_threads(threads);
 
 	int i;
-	int j;
+	/* 0, 1, 2, 3: the sums stay within int32 for n up to 1.4e9 */
 	for(i = 0; i<n; i++)
-		A[i] = i+1;
+	{
+		A[i] = (i & 3);
+		heads[i] = (i % SEGMENT_LENGTH == 0);
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "prefix_sums_%s", alg_names[alg_type]);
 
-	int k, repeats = 100;
-	double elt_avg = 0, elt_sum;
-	for(k = 0; k<repeats; k++)
+	double elt_avg = 0;
+	long count = 0;
+	bench_t b;
+	bench_init(&b, name, 100);
+	/* at best every element is read and written once */
+	bench_set_work(&b, 8.0*n, (double) n);
+	while (bench_next(&b))
 	{
-		double elt = timer();
-		// Upsweep
-		for(i = 0; i<=(int)(log(n-1)/log(2.0)); i++)
+		if (alg_type == ALG_BLELLOCH) {
+			/* the up-sweep works in place, so start from the input again */
+			memcpy(B, A, sizeof(int32_t) * n);
+		}
+		bench_start(&b);
+		switch (alg_type) {
+		case ALG_BLOCKED:
+			scan_i32_blocked(A, B, n, mode);
+			break;
+		case ALG_LOOKBACK:
+			scan_i32_lookback(A, B, n, mode);
+			break;
+		case ALG_BLELLOCH:
+			blelloch_scan(B, n);
+			break;
+		case ALG_SEGMENTED:
+			scan_i32_segmented(A, heads, B, n, mode);
+			break;
+		case ALG_FILTER:
+			SCAN_FILTER(int32_t, A, B, n, count, is_odd);
+			break;
+		case ALG_PARTITION:
+			SCAN_PARTITION(int32_t, A, B, n, count, is_odd);
+			break;
+		}
+		bench_stop(&b);
+	}
+	elt_avg = bench_mean(&b);
+	if (alg_type == ALG_BLOCKED || alg_type == ALG_LOOKBACK)
+		fprintf(stderr, "Block scan kernel: %s\n", scan_isa_names[scan_isa]);
+	//printArray(B, n);
+
+	/* verify against a serial version */
+	if (alg_type == ALG_FILTER || alg_type == ALG_PARTITION) {
+		long kept = 0, dropped = count;
+		for(i = 0; i<n; i++)
 		{
-			int exp = (int) pow(2.0, (double)i+1);
-			int expd = (int) pow(2.0, (double)i);
-			#pragma omp parallel for
-			for(j = 0; j<n; j=j+exp)
-			{
-				A[j+exp-1] = A[j+expd-1] + A[j+exp-1];
+			int ok;
+			if (is_odd(&A[i]))
+				ok = (B[kept++] == A[i]);
+			else
+				ok = (alg_type == ALG_FILTER || B[dropped++] == A[i]);
+			if (!ok || kept > count) {
+				fprintf(stderr, "ERROR: %s wrong at element %d\n", alg, i);
+				exit(2);
 			}
 		}
-		// Set the last index to 0
-		//  printArray(A, n);
-		A[n-1] = 0;
-
-		// Downsweep
-		for(i = (int)(log(n-1)/log(2.0));i>=0; i--)
+		if (kept != count) {
+			fprintf(stderr, "ERROR: %s kept %ld elements, expected %ld\n", alg, count, kept);
+			exit(2);
+		}
+		fprintf(stderr, "Kept: %ld of %d\n", count, n);
+	} else {
+		int64_t run = 0;
+		for(i = 0; i<n; i++)
 		{
-			int exp = (int) pow(2.0, (double)i+1);
-			int expd = (int) pow(2.0, (double)i);
-			#pragma omp parallel for 
-			for(j = 0; j<n; j=j+exp)
-			{
-				int32_t t = A[j+expd-1]; // first saved
-				A[j+expd-1] = A[j+exp-1]; // second stored in first
-				A[j+exp-1] = A[j+exp-1]+t; // stored in second
+			if (alg_type == ALG_SEGMENTED && heads[i])
+				run = 0;
+			if (mode == SCAN_INCLUSIVE)
+				run += A[i];
+			if (B[i] != run) {
+				fprintf(stderr, "ERROR: scan wrong at %d: %d, expected %ld\n", i, B[i], (long) run);
+				exit(2);
 			}
+			if (mode == SCAN_EXCLUSIVE)
+				run += A[i];
 		}
+	}
 
-		elt = timer() - elt;
-		elt_sum+=elt;
+	/* the wider instantiations, untimed */
+	{
+		long m = (n < WIDE_CHECK_MAX) ? n : WIDE_CHECK_MAX;
+		const char *wrong;
+		if ((wrong = scan_i64_check(m, mode)) != NULL) {
+			fprintf(stderr, "ERROR: int64 %s scan wrong\n", wrong);
+			exit(2);
+		}
+		if ((wrong = scan_f64_check(m, mode)) != NULL) {
+			fprintf(stderr, "ERROR: double %s scan wrong\n", wrong);
+			exit(2);
+		}
+		fprintf(stderr, "int64 and double scans match on %ld elements\n", m);
 	}
-	elt_avg = elt_sum/repeats;
-	//printArray(A, n);
 
 	free(A);
+	free(B);
+	free(heads);
 	//fprintf(stderr, "n: %d, approx_pi: %.10lf, total sum: %lf\n",n, approx_pi, sum);
 	fprintf(stderr, "Elapsed time: %9.6lf s\n", elt_avg);
 	// (num_threads*flops_per_thread)/time_taken_in_seconds
 	long double flops = ((n/threads)/1e9/elt_avg)*6;
 	fprintf(stderr, "GFlops rate: %11.6Lf GFlops\n", flops);
+	fprintf(stderr, "Bandwidth (one read + one write): %9.3lf GB/s\n", 8.0*n/(elt_avg*1e9));
+	bench_report(&b);
+	bench_destroy(&b);
 
 	return 0;
 }
@@ -0,0 +1,515 @@
+/* compile the code with gcc -O3 -march=native -fopenmp stockwell_hw1_roofline.c -lm -o roofline */
+/* Roofline model: measures the machine's ceilings and places the other
+   benchmarks' kernels under them.
+ *
+ *  - peak compute: a SIMD FMA kernel with enough independent accumulators
+ *    to hide the FMA latency on every port
+ *  - peak bandwidth: a read kernel with ROOF_ACCUMULATORS independent
+ *    vector sums (one sum would measure add latency, not loads), over a
+ *    working set of half of each data cache level (from
+ *    /sys/devices/system/cpu/cpu0/cache) and one well beyond the last
+ *    level for DRAM
+ *  - kernels: the CSV records the other benchmarks write with
+ *    --format=csv.  Arithmetic intensity is flops per byte of the kernel's
+ *    nominal traffic (bench_set_work).  With --perf in the record, LLC read
+ *    misses times 64 bytes are reported next to it as a lower bound on the
+ *    DRAM traffic only: the event misses stores, write-allocates and
+ *    prefetched lines, so it can't replace the nominal bytes.  The "bound"
+ *    column names the memory level (or compute) whose roof limits the
+ *    kernel.
+ *
+ * For example:
+ *   ./hw 10000000 4 --format=csv --perf > stream.csv
+ *   ./roofline roofline.csv 4 stream.csv
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
+
+/* one vector register per accumulator: 10 accumulators cover 4-cycle FMA
+   latency on two ports and still fit the 16 AVX2 registers with x and y */
+#if defined(__AVX512F__)
+#define ROOF_VEC_BYTES 64
+#elif defined(__AVX__)
+#define ROOF_VEC_BYTES 32
+#else
+#define ROOF_VEC_BYTES 16
+#endif
+#define ROOF_VEC_DOUBLES (ROOF_VEC_BYTES / 8)
+#define ROOF_ACCUMULATORS 10
+
+typedef double roof_vec_t __attribute__((vector_size(ROOF_VEC_BYTES)));
+
+#define ROOF_MAX_LEVELS   8
+#define ROOF_TARGET_TIME  0.05
+#define ROOF_DRAM_MIN     (64L << 20)
+#define ROOF_DRAM_MAX     (1024L << 20)
+
+typedef struct {
+    char name[16];
+    long bytes;         /* working set over all threads */
+    double gb_per_s;
+} roof_level_t;
+
+/* acc = acc*x + y converges to y/(1-x), so no overflow or denormals
+   however long it runs; the result is returned so it isn't optimized out */
+static double fma_kernel(const long iterations) {
+
+    roof_vec_t acc[ROOF_ACCUMULATORS];
+    roof_vec_t x, y;
+    int k, l;
+    for (l=0; l<ROOF_VEC_DOUBLES; l++) {
+        x[l] = 0.999999;
+        y[l] = 1e-7;
+    }
+    for (k=0; k<ROOF_ACCUMULATORS; k++) {
+        for (l=0; l<ROOF_VEC_DOUBLES; l++) {
+            acc[k][l] = 0.1*k + 0.01*l;
+        }
+    }
+
+    long it;
+    for (it=0; it<iterations; it++) {
+        for (k=0; k<ROOF_ACCUMULATORS; k++) {
+            acc[k] = acc[k]*x + y;
+        }
+    }
+
+    double sum = 0.0;
+    for (k=0; k<ROOF_ACCUMULATORS; k++) {
+        for (l=0; l<ROOF_VEC_DOUBLES; l++) {
+            sum += acc[k][l];
+        }
+    }
+    return sum;
+}
+
+static double fma_parallel(const long iterations) {
+
+    double sum = 0.0;
+#pragma omp parallel reduction(+:sum)
+    sum += fma_kernel(iterations);
+    return sum;
+}
+
+/* doubles read per iteration of read_kernel's inner loop */
+#define ROOF_READ_BLOCK (ROOF_ACCUMULATORS * ROOF_VEC_DOUBLES)
+
+/* every thread sums its own static chunk of a passes times, so cache
+   sized chunks stay in the thread's cache between passes; the chunks are
+   whole blocks, into ROOF_ACCUMULATORS independent vector sums so the
+   loads aren't serialized behind one chain of adds */
+static double read_kernel(const double *a, const long n, const long passes) {
+
+    double sum = 0.0;
+#pragma omp parallel reduction(+:sum)
+    {
+        int tid = 0, nthreads = 1;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        nthreads = omp_get_num_threads();
+#endif
+        long blocks = n / ROOF_READ_BLOCK;
+        long lo = blocks * tid / nthreads * ROOF_READ_BLOCK;
+        long hi = (tid == nthreads-1) ? n : blocks * (tid+1) / nthreads * ROOF_READ_BLOCK;
+        long p, i;
+        int k, l;
+        roof_vec_t acc[ROOF_ACCUMULATORS];
+        for (k=0; k<ROOF_ACCUMULATORS; k++) {
+            for (l=0; l<ROOF_VEC_DOUBLES; l++) {
+                acc[k][l] = 0.0;
+            }
+        }
+        double s = 0.0;
+        for (p=0; p<passes; p++) {
+            for (i=lo; i+ROOF_READ_BLOCK<=hi; i+=ROOF_READ_BLOCK) {
+                for (k=0; k<ROOF_ACCUMULATORS; k++) {
+                    roof_vec_t v;
+                    memcpy(&v, &a[i + k*ROOF_VEC_DOUBLES], sizeof(v));
+                    acc[k] += v;
+                }
+            }
+            for (; i<hi; i++) {
+                s += a[i];
+            }
+        }
+        for (k=0; k<ROOF_ACCUMULATORS; k++) {
+            for (l=0; l<ROOF_VEC_DOUBLES; l++) {
+                s += acc[k][l];
+            }
+        }
+        sum += s;
+    }
+    return sum;
+}
+
+static int num_threads(void) {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/* peak GFlop/s over all threads, from the fastest repetition */
+static double measure_fma(void) {
+
+    volatile double sink;
+    long iterations = 1024;
+    double elt;
+    for (;;) {
+        elt = bench_now();
+        sink = fma_parallel(iterations);
+        elt = bench_now() - elt;
+        if (elt >= ROOF_TARGET_TIME || iterations >= (1L << 40))
+            break;
+        iterations *= 2;
+    }
+
+    double flops = 2.0 * ROOF_ACCUMULATORS * ROOF_VEC_DOUBLES * iterations * num_threads();
+    bench_t b;
+    bench_init(&b, "fma_peak", 5);
+    bench_set_work(&b, 0.0, flops);
+    while (bench_next(&b)) {
+        bench_start(&b);
+        sink = fma_parallel(iterations);
+        bench_stop(&b);
+    }
+    (void) sink;
+    double gflops = flops / (bench_stats(&b).min * 1e9);
+    bench_report(&b);
+    bench_destroy(&b);
+
+    return gflops;
+}
+
+/* peak GB/s over all threads for a working set of bytes */
+static double measure_read(const char *name, double *a, const long bytes) {
+
+    long n = bytes / sizeof(double);
+    volatile double sink;
+    long passes = 1;
+    double elt;
+    for (;;) {
+        elt = bench_now();
+        sink = read_kernel(a, n, passes);
+        elt = bench_now() - elt;
+        if (elt >= ROOF_TARGET_TIME || passes >= (1L << 30))
+            break;
+        passes *= 2;
+    }
+
+    bench_t b;
+    bench_init(&b, name, 5);
+    bench_set_work(&b, 8.0 * n * passes, 1.0 * n * passes);
+    while (bench_next(&b)) {
+        bench_start(&b);
+        sink = read_kernel(a, n, passes);
+        bench_stop(&b);
+    }
+    (void) sink;
+    double gbs = 8.0 * n * passes / (bench_stats(&b).min * 1e9);
+    bench_report(&b);
+    bench_destroy(&b);
+
+    return gbs;
+}
+
+static long read_sys_size(const char *path) {
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    long value = -1;
+    char unit = 0;
+    if (fscanf(f, "%ld%c", &value, &unit) < 1)
+        value = -1;
+    fclose(f);
+    if (unit == 'K')
+        value <<= 10;
+    else if (unit == 'M')
+        value <<= 20;
+    else if (unit == 'G')
+        value <<= 30;
+    return value;
+}
+
+/* number of CPUs in a list like "0-3,8-11" */
+static int count_cpu_list(const char *path) {
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 1;
+    int count = 0, lo, hi;
+    char sep;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        sep = 0;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1)
+                hi = lo;
+            if (fscanf(f, "%c", &sep) != 1)
+                sep = 0;
+        }
+        count += hi - lo + 1;
+        if (sep != ',')
+            break;
+    }
+    fclose(f);
+    return count > 0 ? count : 1;
+}
+
+/* Working sets for the data caches of cpu0: half of each level, times the
+   number of thread groups that get a copy of it, then DRAM. */
+static int find_levels(roof_level_t *levels, const int threads) {
+
+    int num_levels = 0, index;
+    long largest = 0;
+    for (index=0; num_levels<ROOF_MAX_LEVELS-1; index++) {
+        char path[128], type[32];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+        FILE *f = fopen(path, "r");
+        if (f == NULL)
+            break;
+        if (fscanf(f, "%31s", type) != 1)
+            type[0] = 0;
+        fclose(f);
+        if (strcmp(type, "Instruction") == 0)
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        long size = read_sys_size(path);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        long level = read_sys_size(path);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/shared_cpu_list", index);
+        int sharers = count_cpu_list(path);
+        if (size <= 0 || level <= 0)
+            continue;
+
+        int copies = (threads + sharers - 1) / sharers;
+        roof_level_t *l = &levels[num_levels++];
+        snprintf(l->name, sizeof(l->name), "L%d", (int) level);
+        l->bytes = size / 2 * copies;
+        if (size * copies > largest)
+            largest = size * copies;
+    }
+
+    if (num_levels == 0) {
+        fprintf(stderr, "no cache sizes in /sys/devices/system/cpu/cpu0/cache, guessing\n");
+        static const long guess[3] = { 32L << 10, 256L << 10, 8L << 20 };
+        for (index=0; index<3; index++) {
+            snprintf(levels[index].name, sizeof(levels[index].name), "L%d", index+1);
+            levels[index].bytes = guess[index] / 2;
+        }
+        num_levels = 3;
+        largest = guess[2];
+    }
+
+    long dram = 4 * largest;
+    if (dram < ROOF_DRAM_MIN)
+        dram = ROOF_DRAM_MIN;
+    if (dram > ROOF_DRAM_MAX)
+        dram = ROOF_DRAM_MAX;
+    snprintf(levels[num_levels].name, sizeof(levels[num_levels].name), "DRAM");
+    levels[num_levels].bytes = dram;
+    return num_levels + 1;
+}
+
+/* column index of name in a CSV header line, -1 if missing */
+static int csv_column(const char *header, const char *name) {
+
+    int col = 0;
+    size_t len = strlen(name);
+    const char *p = header;
+    while (*p) {
+        if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\n' || p[len] == 0))
+            return col;
+        p = strchr(p, ',');
+        if (p == NULL)
+            break;
+        p++;
+        col++;
+    }
+    return -1;
+}
+
+/* field col of a CSV line, copied to out; returns 0 if empty or missing */
+static int csv_field(const char *line, const int col, char *out, const int size) {
+
+    const char *p = line;
+    int c;
+    for (c=0; c<col && p; c++) {
+        p = strchr(p, ',');
+        if (p)
+            p++;
+    }
+    if (p == NULL)
+        return 0;
+    int len = 0;
+    while (p[len] && p[len] != ',' && p[len] != '\n' && len < size-1) {
+        out[len] = p[len];
+        len++;
+    }
+    out[len] = 0;
+    return len > 0;
+}
+
+/* Place every record of a harness CSV file under the DRAM roof.  A kernel
+   whose data stays in cache can beat that roof; it is then attributed to
+   the slowest cache level whose roof still covers it. */
+static void place_kernels(const char *filename, FILE *out, const double peak_gflops,
+                          const roof_level_t *levels, const int num_levels) {
+
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "could not open %s, skipping\n", filename);
+        return;
+    }
+
+    char header[1024], line[1024], field[256], name[256];
+    if (fgets(header, sizeof(header), f) == NULL) {
+        fclose(f);
+        return;
+    }
+    int c_name = csv_column(header, "name");
+    int c_mean = csv_column(header, "mean_s");
+    int c_gbs = csv_column(header, "gb_per_s");
+    int c_gflops = csv_column(header, "gflop_per_s");
+    int c_llc = csv_column(header, "llc_misses");
+    if (c_name < 0 || c_gbs < 0 || c_gflops < 0) {
+        fprintf(stderr, "%s is not a --format=csv benchmark record, skipping\n", filename);
+        fclose(f);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        if (!csv_field(line, c_name, name, sizeof(name)))
+            continue;
+        double gbs = csv_field(line, c_gbs, field, sizeof(field)) ? atof(field) : 0.0;
+        double gflops = csv_field(line, c_gflops, field, sizeof(field)) ? atof(field) : 0.0;
+
+        /* LLC read misses, a lower bound on the DRAM traffic; the counts
+           are means per repetition, so they go with the mean time */
+        double llc_gbs = -1.0;
+        if (c_llc >= 0 && c_mean >= 0 && csv_field(line, c_llc, field, sizeof(field))) {
+            double llc = atof(field);
+            double mean = csv_field(line, c_mean, field, sizeof(field)) ? atof(field) : 0.0;
+            if (mean > 0)
+                llc_gbs = llc * BENCH_LINE_SIZE / (mean * 1e9);
+        }
+
+        if (gflops <= 0.0) {
+            fprintf(stderr, "%-40s no flop count, can't be placed\n", name);
+            continue;
+        }
+        if (gbs <= 0.0) {
+            fprintf(stderr, "%-40s no byte count, can't be placed\n", name);
+            continue;
+        }
+        double intensity = gflops / gbs;
+        int l = num_levels - 1;
+        while (l > 0 && gflops > intensity * levels[l].gb_per_s)
+            l--;
+        double attainable = fmin(peak_gflops, intensity * levels[l].gb_per_s);
+        const char *bound = (intensity * levels[l].gb_per_s < peak_gflops) ?
+                            levels[l].name : "compute";
+
+        char llc_text[64] = "", llc_csv[32] = "";
+        if (llc_gbs >= 0.0) {
+            snprintf(llc_text, sizeof(llc_text), " (DRAM >= %.3lf GB/s)", llc_gbs);
+            snprintf(llc_csv, sizeof(llc_csv), "%.6lf", llc_gbs);
+        }
+        fprintf(stderr, "%-40s %10.3lf %10.3lf %12.3lf %8s %7.1lf%%%s\n",
+                name, intensity, gflops, attainable, bound,
+                100.0 * gflops / attainable, llc_text);
+        fprintf(out, "kernel,%s,%.6lf,%.6lf,%.6lf,%.6lf,%s,%s\n",
+                name, intensity, gflops, gbs, attainable, bound, llc_csv);
+    }
+    fclose(f);
+}
+
+
+int main(int argc, char **argv)
+{
+
+    bench_alloc_args(&argc, argv);
+    bench_harness_args(&argc, argv);
+
+    if (argc < 3) {
+        fprintf(stderr, "%s <csv file> <threads> [benchmark csv ...]\n", argv[0]);
+        fprintf(stderr, "measures peak FMA throughput and L1..DRAM read bandwidth, then places\n");
+        fprintf(stderr, "the kernels from other benchmarks' --format=csv output on the roofline\n");
+        fprintf(stderr, "(add --perf to those runs for a lower bound on their DRAM traffic)\n");
+        exit(1);
+    }
+
+    int threads = atoi(argv[2]);
+    assert(threads > 0);
+#ifdef _OPENMP
+    omp_set_dynamic(0);
+    omp_set_num_threads(threads);
+#else
+    threads = 1;
+#endif
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL) {
+        fprintf(stderr, "could not open %s for writing\n", argv[1]);
+        exit(1);
+    }
+
+    roof_level_t levels[ROOF_MAX_LEVELS];
+    int num_levels = find_levels(levels, threads);
+
+    double *a = (double *) bench_alloc(levels[num_levels-1].bytes);
+    assert(a != 0);
+    long i, n = levels[num_levels-1].bytes / sizeof(double);
+#pragma omp parallel for schedule(static)
+    for (i=0; i<n; i++) {
+        a[i] = 1.0;
+    }
+
+    double peak_gflops = measure_fma();
+    int l;
+    for (l=0; l<num_levels; l++) {
+        char name[32];
+        snprintf(name, sizeof(name), "read_%.15s", levels[l].name);
+        levels[l].gb_per_s = measure_read(name, a, levels[l].bytes);
+    }
+    bench_free(a);
+
+    /* ceilings: the memory rows' intensity is the ridge point */
+    fprintf(out, "kind,name,intensity,gflop_per_s,gb_per_s,attainable_gflop_per_s,bound,llc_read_gb_per_s_min\n");
+    fprintf(out, "ceiling,fma,,%.6lf,,%.6lf,compute,\n", peak_gflops, peak_gflops);
+
+    fprintf(stderr, "\nthreads: %d, vector: %d bytes, accumulators: %d\n",
+            threads, ROOF_VEC_BYTES, ROOF_ACCUMULATORS);
+    fprintf(stderr, "Peak FMA:  %10.3lf GFlop/s\n", peak_gflops);
+    for (l=0; l<num_levels; l++) {
+        fprintf(stderr, "Peak %-4s  %10.3lf GB/s  (working set %.1lf KB), ridge at %.3lf flop/byte\n",
+                levels[l].name, levels[l].gb_per_s, levels[l].bytes/1024.0,
+                peak_gflops / levels[l].gb_per_s);
+        fprintf(out, "ceiling,%s,%.6lf,,%.6lf,%.6lf,memory,\n", levels[l].name,
+                peak_gflops / levels[l].gb_per_s, levels[l].gb_per_s, peak_gflops);
+    }
+
+    if (argc > 3) {
+        fprintf(stderr, "\n%-40s %10s %10s %12s %8s %8s\n", "kernel", "flop/byte",
+                "GFlop/s", "attainable", "bound", "of roof");
+    }
+    int arg;
+    for (arg=3; arg<argc; arg++) {
+        place_kernels(argv[arg], out, peak_gflops, levels, num_levels);
+    }
+
+    fclose(out);
+
+    return 0;
+}
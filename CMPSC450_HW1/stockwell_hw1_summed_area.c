@@ -0,0 +1,210 @@
+/* compile the code with gcc -O3 -fopenmp stockwell_hw1_summed_area.c -lm -o hw*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <math.h>
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
+#include "summed_area.h"
+
+/* brute-force checks of random rectangles after the query benchmark */
+#define NUM_CHECKS 16
+
+/* pixel-like values in 0..255 */
+#define PIXEL(r, c) ((int32_t) (((r)*7 + (c)*3) & 255))
+
+/* linear congruential generator for the query rectangles, one per thread */
+static inline uint64_t next_rand(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return *state >> 33;
+}
+
+static void random_rect(uint64_t *state, long rows, long cols, long *r0, long *c0, long *r1, long *c1)
+{
+	long a = next_rand(state) % rows, b = next_rand(state) % rows;
+	long c = next_rand(state) % cols, d = next_rand(state) % cols;
+	*r0 = (a < b) ? a : b;
+	*r1 = (a < b) ? b : a;
+	*c0 = (c < d) ? c : d;
+	*c1 = (c < d) ? d : c;
+}
+
+int main(int argc, char **argv)
+{
+	bench_alloc_args(&argc, argv);
+	bench_harness_args(&argc, argv);
+
+	if(argc<4 || argc>6)
+	{
+		fprintf(stderr, "Needs <rows> <cols> <threads> [int64|double] [queries]\n");
+		fprintf(stderr, "int64:  int32 pixels summed into int64 (default)\n");
+		fprintf(stderr, "double: double pixels summed into double\n");
+		fprintf(stderr, "queries: random rectangle sums timed after the build (default 10000000)\n");
+		fprintf(stderr, "--bind=compact|scatter|core pins the default OpenMP team, not nested teams (see common/bench_topo.h)\n");
+		exit(1);
+	}
+
+	// Turn off dynamic teaming
+	omp_set_dynamic(0);
+
+	long rows = atol(argv[1]);
+	long cols = atol(argv[2]);
+	int threads = atoi(argv[3]);
+	int use_double = (argc > 4 && strcmp(argv[4], "double") == 0);
+	long queries = (argc > 5) ? atol(argv[5]) : 10000000;
+	assert(rows > 0);
+	assert(cols > 0);
+	assert(threads > 0);
+	assert(queries >= 0);
+	if (argc > 4 && !use_double && strcmp(argv[4], "int64") != 0) {
+		fprintf(stderr, "unknown type %s, use int64 or double\n", argv[4]);
+		exit(1);
+	}
+
+	omp_set_num_threads(threads);
+
+	long n = rows*cols;
+	size_t in_size = use_double ? sizeof(double) : sizeof(int32_t);
+	void *in = bench_alloc(n * in_size);
+	void *sat = bench_alloc(n * 8);
+	void *ref = bench_alloc(n * 8);
+	assert(in != 0);
+	assert(sat != 0);
+	assert(ref != 0);
+
+	long r, c;
+	/* first touch by the threads that own the rows in the horizontal pass */
+	#pragma omp parallel for schedule(static) private(c)
+	for (r=0; r<rows; r++)
+	{
+		for (c=0; c<cols; c++)
+		{
+			if (use_double)
+				((double *) in)[r*cols + c] = PIXEL(r, c) / 256.0;
+			else
+				((int32_t *) in)[r*cols + c] = PIXEL(r, c);
+			((int64_t *) sat)[r*cols + c] = 0;
+		}
+	}
+
+	/* serial reference, same order of additions as the parallel build */
+	for (r=0; r<rows; r++)
+	{
+		for (c=0; c<cols; c++)
+		{
+			if (use_double) {
+				double *R = ref;
+				double x = ((double *) in)[r*cols + c];
+				R[r*cols + c] = ((c > 0) ? R[r*cols + c-1] : 0) + x;
+			} else {
+				int64_t *R = ref;
+				int64_t x = ((int32_t *) in)[r*cols + c];
+				R[r*cols + c] = ((c > 0) ? R[r*cols + c-1] : 0) + x;
+			}
+		}
+	}
+	for (r=1; r<rows; r++)
+	{
+		for (c=0; c<cols; c++)
+		{
+			if (use_double)
+				((double *) ref)[r*cols + c] += ((double *) ref)[(r-1)*cols + c];
+			else
+				((int64_t *) ref)[r*cols + c] += ((int64_t *) ref)[(r-1)*cols + c];
+		}
+	}
+
+	bench_t b;
+	bench_init(&b, use_double ? "summed_area_f64" : "summed_area_i64", 20);
+	/* horizontal pass: read in, write the table; vertical: read two rows, write one */
+	bench_set_work(&b, (double) n * (in_size + 8 + 8 + 8), 2.0*n);
+	while (bench_next(&b))
+	{
+		bench_start(&b);
+		if (use_double)
+			sat_f64_build(in, sat, rows, cols);
+		else
+			sat_i64_build(in, sat, rows, cols);
+		bench_stop(&b);
+	}
+	double elt_avg = bench_mean(&b);
+
+	if (memcmp(sat, ref, n * 8) != 0) {
+		for (r=0; r<n; r++) {
+			if (((int64_t *) sat)[r] != ((int64_t *) ref)[r])
+				break;
+		}
+		fprintf(stderr, "ERROR: table wrong at row %ld, column %ld\n", r / cols, r % cols);
+		exit(2);
+	}
+
+	fprintf(stderr, "Elapsed time: %9.6lf s\n", elt_avg);
+	fprintf(stderr, "Build rate: %9.3lf Gpixels/s\n", n/(elt_avg*1e9));
+	bench_report(&b);
+	bench_destroy(&b);
+
+	/* random rectangle queries, every thread with its own generator */
+	double checksum = 0;
+	double start = omp_get_wtime();
+	#pragma omp parallel reduction(+:checksum)
+	{
+		uint64_t state = 12345 + omp_get_thread_num();
+		long q, r0, c0, r1, c1;
+		#pragma omp for schedule(static)
+		for (q=0; q<queries; q++)
+		{
+			random_rect(&state, rows, cols, &r0, &c0, &r1, &c1);
+			if (use_double)
+				checksum += sat_f64_rect(sat, cols, r0, c0, r1, c1);
+			else
+				checksum += sat_i64_rect(sat, cols, r0, c0, r1, c1);
+		}
+	}
+	double query_time = omp_get_wtime() - start;
+	if (queries > 0)
+		fprintf(stderr, "Queries: %ld in %9.6lf s, %9.3lf M/s (checksum %g)\n",
+		        queries, query_time, queries/(query_time*1e6), checksum);
+
+	/* check a few rectangles against a direct sum of the pixels */
+	uint64_t state = 54321;
+	int k;
+	for (k=0; k<NUM_CHECKS; k++)
+	{
+		long r0, c0, r1, c1;
+		random_rect(&state, rows, cols, &r0, &c0, &r1, &c1);
+		double direct = 0;
+		int64_t direct_i = 0;
+		for (r=r0; r<=r1; r++)
+		{
+			for (c=c0; c<=c1; c++)
+			{
+				direct += (use_double) ? ((double *) in)[r*cols + c] : 0;
+				direct_i += (use_double) ? 0 : ((int32_t *) in)[r*cols + c];
+			}
+		}
+		int ok;
+		if (use_double) {
+			double got = sat_f64_rect(sat, cols, r0, c0, r1, c1);
+			/* the lookups are as large as the whole image's sum, so
+			   the rounding error is relative to that */
+			double total = ((double *) sat)[n-1];
+			ok = (fabs(got - direct) <= 1e-12 * (1 + total));
+		} else {
+			ok = (sat_i64_rect(sat, cols, r0, c0, r1, c1) == direct_i);
+		}
+		if (!ok) {
+			fprintf(stderr, "ERROR: rectangle (%ld,%ld)-(%ld,%ld) wrong\n", r0, c0, r1, c1);
+			exit(2);
+		}
+	}
+
+	bench_free(in);
+	bench_free(sat);
+	bench_free(ref);
+
+	return 0;
+}
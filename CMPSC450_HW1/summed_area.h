@@ -0,0 +1,101 @@
+/* Parallel 2D summed-area tables (integral images), the 2D version of the
+ * prefix sums in prefix_scan.h.
+ *
+ * sat_<t>_build(in, out, rows, cols): out[r][c] = sum of in[0..r][0..c]
+ *   for a row-major rows x cols matrix, in two passes:
+ *   1. horizontal: every row is scanned on its own, the rows are split
+ *      statically over the threads
+ *   2. vertical: the columns are cut into tiles of SAT_TILE_COLS and every
+ *      thread adds each row of its tiles onto the row above, walking down.
+ *      A tile row is one contiguous run of memory, so the pass streams
+ *      through rows instead of striding down single columns, and the row
+ *      above is still in L1 when it is added.
+ *   Each pass reads and writes the table once.
+ *
+ * sat_<t>_rect(sat, cols, r0, c0, r1, c1): sum of in[r0..r1][c0..c1]
+ *   (inclusive) from at most four table lookups.
+ *
+ * Instantiated as sat_i64 (int32_t in, int64_t sums, exact for any image
+ * that fits in memory) and sat_f64 (double in and out).
+ */
+#ifndef SUMMED_AREA_H
+#define SUMMED_AREA_H
+
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* columns per vertical tile: 4 KB of int64/double per tile row */
+#define SAT_TILE_COLS 512
+
+/* narrowest tile when there are few columns, one cache line of sums */
+#define SAT_MIN_TILE_COLS 8
+
+static inline int sat_max_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/* SAT_DEFINE(IN, ACC, NAME) defines NAME_build and NAME_rect summing
+   elements of type IN into ACC */
+#define SAT_DEFINE(IN, ACC, NAME) \
+\
+static inline void NAME##_build(const IN *in, ACC *out, long rows, long cols) \
+{ \
+	int nthreads = sat_max_threads(); \
+	/* narrower tiles when the columns can't keep every thread busy */ \
+	long tile = (cols + nthreads - 1) / nthreads; \
+	tile = (tile + SAT_MIN_TILE_COLS - 1) / SAT_MIN_TILE_COLS * SAT_MIN_TILE_COLS; \
+	if (tile > SAT_TILE_COLS) \
+		tile = SAT_TILE_COLS; \
+	long ntiles = (cols + tile - 1) / tile; \
+	long r, c, t; \
+\
+	_Pragma("omp parallel private(r, c, t)") \
+	{ \
+		_Pragma("omp for schedule(static)") \
+		for (r=0; r<rows; r++) { \
+			const IN *src = in + r*cols; \
+			ACC *dst = out + r*cols; \
+			ACC run = 0; \
+			for (c=0; c<cols; c++) { \
+				run += src[c]; \
+				dst[c] = run; \
+			} \
+		} \
+\
+		_Pragma("omp for schedule(static)") \
+		for (t=0; t<ntiles; t++) { \
+			long lo = t*tile; \
+			long hi = (lo + tile < cols) ? lo + tile : cols; \
+			for (r=1; r<rows; r++) { \
+				const ACC *above = out + (r-1)*cols; \
+				ACC *row = out + r*cols; \
+				for (c=lo; c<hi; c++) \
+					row[c] += above[c]; \
+			} \
+		} \
+	} \
+} \
+\
+static inline ACC NAME##_rect(const ACC *sat, long cols, long r0, long c0, long r1, long c1) \
+{ \
+	ACC sum = sat[r1*cols + c1]; \
+	if (r0 > 0) \
+		sum -= sat[(r0-1)*cols + c1]; \
+	if (c0 > 0) \
+		sum -= sat[r1*cols + c0-1]; \
+	if (r0 > 0 && c0 > 0) \
+		sum += sat[(r0-1)*cols + c0-1]; \
+	return sum; \
+}
+
+SAT_DEFINE(int32_t, int64_t, sat_i64)
+SAT_DEFINE(double, double, sat_f64)
+
+#endif
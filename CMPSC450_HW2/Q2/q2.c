@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cmpsc473mr.h"
+#include "../../common/padded_per_thread.h"
 
 #define STRMAX 25
 
@@ -47,8 +48,11 @@ typedef struct __adder_arg_t
 /*##Variables##*/
 node_t **buffer_reader_array;
 node_t **buffer_adder_array;
-int **bw_size_array;
-int **br_size_array;
+// Buffer sizes, one per replica. Each one is updated by its reader and adder
+// threads, so they get a cache line each; separate malloc(sizeof(int))s end up
+// next to each other and every replica's updates invalidated the others'.
+ppt_int_t bw_sizes;
+ppt_int_t br_sizes;
 int replicas;
 int bufferMaxSize;
 int *threads_returned;
@@ -84,8 +88,10 @@ int main(int argc, void *argv[])
 	*threads_returned = 0;
 	finalList = NULL;
 
-	br_size_array = malloc(sizeof(int*)*replicas);
-	bw_size_array = malloc(sizeof(int*)*replicas);
+	/* no OpenMP here, so this thread first-touches every slot; they are
+	   shared by a replica's reader and adder anyway */
+	ppt_int_init(&br_sizes, replicas, 0, PPT_LINE);
+	ppt_int_init(&bw_sizes, replicas, 0, PPT_LINE);
 	buffer_adder_array = malloc(sizeof(node_t*)*replicas);
 	buffer_reader_array = malloc(sizeof(node_t*)*replicas);
 
@@ -93,10 +99,6 @@ int main(int argc, void *argv[])
 	{
 		buffer_adder_array[i-1] = NULL;
 		buffer_reader_array[i-1] = NULL;
-		bw_size_array[i-1] = malloc(sizeof(int));
-		*(bw_size_array[i-1]) = 0;
-		br_size_array[i-1] = malloc(sizeof(int));
-		*(br_size_array[i-1]) = 0;
 
 		mapper(filename, i);
 	}
@@ -107,12 +109,6 @@ int main(int argc, void *argv[])
 
 	printlist(&finalList);
 
-	for(int i = 0; i<replicas; i++)
-	{
-		free(bw_size_array[i]);
-		free(br_size_array[i]);
-	}
-
 	// Free everything
 	node_t *current = finalList;
 	node_t *previous = NULL;
@@ -123,8 +119,8 @@ int main(int argc, void *argv[])
 		current = current->next;
 		free(previous);
 	}
-	free(bw_size_array);
-	free(br_size_array);
+	ppt_int_destroy(&bw_sizes);
+	ppt_int_destroy(&br_sizes);
 	free(buffer_adder_array);
 	free(buffer_reader_array);
 	free(threads_returned);
@@ -213,7 +209,7 @@ void reducer()
 		}
 
 		// Pop the head from the first non-empty list
-		node_t* word = popHead(&buffer_adder_array[i], bw_size_array[i]);
+		node_t* word = popHead(&buffer_adder_array[i], ppt_int_slot(&bw_sizes, i));
 
 		// Add that node to the finalList of nodes
 		push(&word, &finalList, flSize);
@@ -224,7 +220,7 @@ void reducer()
 			node_t *previous = NULL;
 
 			// Find a match for the head of finalList
-			match = findMatch(&(buffer_adder_array[j]), finalList->word, &previous, *(bw_size_array[j]));
+			match = findMatch(&(buffer_adder_array[j]), finalList->word, &previous, *(ppt_int_slot(&bw_sizes, j)));
 
 			if(previous && match)
 			{
@@ -237,12 +233,12 @@ void reducer()
 				// Free the temporary node
 				free(match);
 				match = NULL;
-				--((*bw_size_array[j]));
+				--((*ppt_int_slot(&bw_sizes, j)));
 			}
 			else if(match)
 			{
 				// The match was the head, so pop it
-				node_t *temp = popHead(&(buffer_adder_array[i]), bw_size_array[i]);
+				node_t *temp = popHead(&(buffer_adder_array[i]), ppt_int_slot(&bw_sizes, i));
 
 				if(!temp)
 				{
@@ -255,7 +251,7 @@ void reducer()
 				// Free the temporary node
 				free(temp);
 				temp = NULL;
-				--((*bw_size_array[j]));
+				--((*ppt_int_slot(&bw_sizes, j)));
 			}
 		}
 
@@ -275,7 +271,7 @@ void *map_reader(void *arg)
 	char *filename = reader->filename;
 	char delimiters[2] = {'\n',' '};
 
-	int *brSize = br_size_array[replica-1];
+	int *brSize = ppt_int_slot(&br_sizes, replica-1);
 	node_t **buffer_read = &buffer_reader_array[replica-1];
 
 	// Create a new file pointer so the various threads don't mess with pointer positions
@@ -367,8 +363,8 @@ void *map_adder(void *arg)
 
 	node_t **buffer_read = &buffer_reader_array[replica-1];
 	node_t **buffer_write = &buffer_adder_array[replica-1];
-	int *brSize = br_size_array[replica-1];
-	int *bwSize = bw_size_array[replica-1];
+	int *brSize = ppt_int_slot(&br_sizes, replica-1);
+	int *bwSize = ppt_int_slot(&bw_sizes, replica-1);
 
 	node_t *nothing = NULL;
 	// While mapper is not done, or while buffer_read has items
@@ -3,32 +3,16 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <time.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 #include "qsort.h"
-
-float *globA;
-float *globB;
-float *globC;
-float *top;
-float *bot;
-
-static double timer() {
-
-	struct timeval tp;
-	gettimeofday(&tp, NULL);
-	return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-	/* The code below is for another high resolution timer */
-	/* I'm using gettimeofday because it's more portable */
-
-	/*
-	   struct timespec tp;
-	   clock_gettime(CLOCK_MONOTONIC, &tp);
-	   return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-	   */
-}
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
+#include "../common/padded_per_thread.h"
 
 void printArray(float *A, int n)
 {
@@ -63,18 +47,19 @@ static int inline_qsort_serial(const float *A, const int n, const int num_iterat
 
 	fprintf(stderr, "N %d\n", n);
 	fprintf(stderr, "Using inline qsort implementation\n");
-	fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+	fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-	int iter;
 	double avg_elt;
 
 	float *B;
-	B = (float *) malloc(n * sizeof(float));
+	B = (float *) bench_alloc(n * sizeof(float));
 	assert(B != NULL);
 
-	avg_elt = 0.0;
+	bench_t b;
+	bench_init(&b, "inline_qsort_serial", num_iterations);
+	bench_set_work(&b, 4.0*n, 0.0);
 
-	for (iter = 0; iter < num_iterations; iter++) {
+	while (bench_next(&b)) {
 
 		int i;
 
@@ -83,12 +68,11 @@ static int inline_qsort_serial(const float *A, const int n, const int num_iterat
 		}
 
 		double elt;
-		elt = timer();
+		bench_start(&b);
 
 		QSORT(float, B, n, inline_qs_cmpf);
 
-		elt = timer() - elt;
-		avg_elt += elt;
+		elt = bench_stop(&b);
 		fprintf(stderr, "%9.3lf\n", elt*1e3);
 
 		/* correctness check */
@@ -98,12 +82,14 @@ static int inline_qsort_serial(const float *A, const int n, const int num_iterat
 
 	}
 
-	avg_elt = avg_elt/num_iterations;
+	avg_elt = bench_mean(&b);
 
-	free(B);
+	bench_free(B);
 
 	fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
 	fprintf(stderr, "Average sort rate: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+	bench_report(&b);
+	bench_destroy(&b);
 	return 0;
 
 }
@@ -112,18 +98,19 @@ static int qsort_serial(const float *A, const int n, const int num_iterations) {
 
 	fprintf(stderr, "N %d\n", n);
 	fprintf(stderr, "Using C qsort\n");
-	fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+	fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-	int iter;
 	double avg_elt;
 
 	float *B;
-	B = (float *) malloc(n * sizeof(float));
+	B = (float *) bench_alloc(n * sizeof(float));
 	assert(B != NULL);
 
-	avg_elt = 0.0;
+	bench_t b;
+	bench_init(&b, "qsort_serial", num_iterations);
+	bench_set_work(&b, 4.0*n, 0.0);
 
-	for (iter = 0; iter < num_iterations; iter++) {
+	while (bench_next(&b)) {
 
 		int i;
 
@@ -132,12 +119,11 @@ static int qsort_serial(const float *A, const int n, const int num_iterations) {
 		}
 
 		double elt;
-		elt = timer();
+		bench_start(&b);
 
 		qsort(B, n, sizeof(float), qs_cmpf);
 
-		elt = timer() - elt;
-		avg_elt += elt;
+		elt = bench_stop(&b);
 		fprintf(stderr, "%9.3lf\n", elt*1e3);
 
 		/* correctness check */
@@ -147,188 +133,740 @@ static int qsort_serial(const float *A, const int n, const int num_iterations) {
 
 	}
 
-	avg_elt = avg_elt/num_iterations;
+	avg_elt = bench_mean(&b);
 
-	free(B);
+	bench_free(B);
 
 	fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
 	fprintf(stderr, "Average sort rate: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+	bench_report(&b);
+	bench_destroy(&b);
 	return 0;
 
 }
 
-void copyArray(float *A, float *B, int begin, int end)
+/* LSD radix sort on the IEEE bit patterns.
+ *
+ * Flipping the sign bit of positive floats and all bits of negative ones
+ * turns the bit patterns into unsigned keys that sort like the floats.
+ * The keys are sorted a RADIX_BITS digit at a time, least significant
+ * first, each pass a stable counting sort from one buffer into the other:
+ *   1. every thread counts the digits of its block
+ *   2. thread t's elements with digit d go after all elements with smaller
+ *      digits and the digit-d elements of threads 0..t-1
+ *   3. every thread scatters its block.  Elements are staged in a
+ *      cache-line buffer per digit and written out a full line at a time,
+ *      so the scatter's 2^RADIX_BITS write streams don't each miss on
+ *      every element.
+ * The digit counts of the whole array don't depend on the order, so they
+ * are taken once up front, and a pass where every element has the same
+ * digit is skipped.  The first pass reads floats and the last one writes
+ * them back, so there are no separate transform passes.
+ */
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+
+/* elements staged per digit, one 64-byte line */
+#define RADIX_WC 16
+
+typedef union {
+	float f;
+	uint32_t u;
+} flt_bits_t;
+
+static inline uint32_t radix_key(uint32_t u)
 {
-	int i;
-	
+	return u ^ ((u >> 31) ? 0xffffffffu : 0x80000000u);
+}
+
+static inline uint32_t radix_unkey(uint32_t k)
+{
+	return k ^ ((k >> 31) ? 0x80000000u : 0xffffffffu);
+}
+
+/* sorts A[0..n) using tmp[0..n) as the other buffer */
+void radix_sort(float *A, float *tmp, int n)
+{
+	int max_threads = 1;
 #ifdef _OPENMP
-	#pragma omp for
+	max_threads = omp_get_max_threads();
 #endif
-	for(i = 0; i<end; i++)
+	/* per-thread digit counts; one row is 2 KB, so rows don't share lines */
+	long (*counts)[RADIX_BUCKETS] = malloc(sizeof(long) * RADIX_BUCKETS * max_threads);
+	long totals[RADIX_PASSES][RADIX_BUCKETS];
+	int needed[RADIX_PASSES];
+	assert(counts != NULL);
+	memset(totals, 0, sizeof(totals));
+
+	flt_bits_t *bufs[2] = { (flt_bits_t *) A, (flt_bits_t *) tmp };
+	int cur = 0;
+
+#pragma omp parallel
+{
+	int tid = 0, nthreads = 1;
+#ifdef _OPENMP
+	tid = omp_get_thread_num();
+	nthreads = omp_get_num_threads();
+#endif
+	long lo = (long) n * tid / nthreads;
+	long hi = (long) n * (tid + 1) / nthreads;
+	long i;
+	int p, d, t;
+
+	/* digit counts of the whole array, for every pass at once */
+	long mine[RADIX_PASSES][RADIX_BUCKETS];
+	memset(mine, 0, sizeof(mine));
+	for (i=lo; i<hi; i++) {
+		uint32_t k = radix_key(bufs[0][i].u);
+		for (p=0; p<RADIX_PASSES; p++)
+			mine[p][(k >> (p*RADIX_BITS)) & (RADIX_BUCKETS-1)]++;
+	}
+#pragma omp critical
+	for (p=0; p<RADIX_PASSES; p++) {
+		for (d=0; d<RADIX_BUCKETS; d++)
+			totals[p][d] += mine[p][d];
+	}
+#pragma omp barrier
+#pragma omp single
 	{
-		B[i] = A[i];
+		int last = -1;
+		for (p=0; p<RADIX_PASSES; p++) {
+			needed[p] = 1;
+			for (d=0; d<RADIX_BUCKETS; d++) {
+				if (totals[p][d] == n)
+					needed[p] = 0;
+			}
+			if (needed[p])
+				last = p;
+		}
+		/* mark the last pass that runs with 2, it writes floats */
+		if (last >= 0)
+			needed[last] = 2;
+	}
+
+	uint32_t wc[RADIX_BUCKETS][RADIX_WC] __attribute__((aligned(64)));
+	int fill[RADIX_BUCKETS];
+	long pos[RADIX_BUCKETS];
+	int keyed = 0;   /* whether the buffers hold keys yet */
+
+	for (p=0; p<RADIX_PASSES; p++) {
+		if (!needed[p])
+			continue;
+		int shift = p*RADIX_BITS;
+		const flt_bits_t *src = bufs[cur];
+		flt_bits_t *dst = bufs[cur ^ 1];
+
+		memset(counts[tid], 0, sizeof(counts[tid]));
+		for (i=lo; i<hi; i++) {
+			uint32_t k = keyed ? src[i].u : radix_key(src[i].u);
+			counts[tid][(k >> shift) & (RADIX_BUCKETS-1)]++;
+		}
+#pragma omp barrier
+
+		long base = 0;
+		for (d=0; d<RADIX_BUCKETS; d++) {
+			long before = 0;
+			for (t=0; t<tid; t++)
+				before += counts[t][d];
+			pos[d] = base + before;
+			fill[d] = 0;
+			base += totals[p][d];
+		}
+
+		for (i=lo; i<hi; i++) {
+			uint32_t k = keyed ? src[i].u : radix_key(src[i].u);
+			d = (k >> shift) & (RADIX_BUCKETS-1);
+			wc[d][fill[d]++] = (needed[p] == 2) ? radix_unkey(k) : k;
+			if (fill[d] == RADIX_WC) {
+				memcpy(&dst[pos[d]], wc[d], sizeof(wc[d]));
+				pos[d] += RADIX_WC;
+				fill[d] = 0;
+			}
+		}
+		for (d=0; d<RADIX_BUCKETS; d++)
+			memcpy(&dst[pos[d]], wc[d], fill[d] * sizeof(uint32_t));
+
+		keyed = 1;
+		/* everyone has read src and counts before they are reused */
+#pragma omp barrier
+#pragma omp single
+		cur ^= 1;
 	}
+
+	/* an odd number of passes leaves the result in tmp */
+	if (cur == 1) {
+#pragma omp for
+		for (i=0; i<n; i++)
+			A[i] = tmp[i];
+	}
+}
+
+	free(counts);
 }
 
-void merge(int begin, int mid, int end)
+static int radix_sort_parallel(const float *A, const int n, const int num_iterations) {
+
+	fprintf(stderr, "N %d\n", n);
+	fprintf(stderr, "Using parallel LSD radix sort, %d-bit digits\n", RADIX_BITS);
+	fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
+
+	double avg_elt;
+
+	float *B, *tmp;
+	B = (float *) bench_alloc(n * sizeof(float));
+	assert(B != NULL);
+	tmp = (float *) bench_alloc(n * sizeof(float));
+	assert(tmp != NULL);
+
+	bench_t b;
+	bench_init(&b, "radix_sort_parallel", num_iterations);
+	/* per pass: count read, scatter read and write */
+	bench_set_work(&b, 4.0*n*(1 + 3*RADIX_PASSES), 0.0);
+
+	while (bench_next(&b)) {
+
+		int i;
+
+#pragma omp parallel for private(i)
+		for (i=0; i<n; i++) {
+			B[i] = A[i];
+			tmp[i] = 0;
+		}
+
+		double elt;
+		bench_start(&b);
+
+		radix_sort(B, tmp, n);
+
+		elt = bench_stop(&b);
+		fprintf(stderr, "%9.3lf\n", elt*1e3);
+
+		/* correctness check */
+		for (i=1; i<n; i++) {
+			assert(B[i] >= B[i-1]);
+		}
+
+	}
+
+	avg_elt = bench_mean(&b);
+
+	bench_free(B);
+	bench_free(tmp);
+
+	fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
+	fprintf(stderr, "Average sort rate: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+	bench_report(&b);
+	bench_destroy(&b);
+	return 0;
+
+}
+
+/* Sample sort: one bucket per thread.
+ *
+ * A random sample of SAMPLE_OVERSAMPLE elements per bucket is sorted and
+ * every SAMPLE_OVERSAMPLE-th element becomes a splitter, so the buckets
+ * come out close to n/p even when the values are skewed.  Every element
+ * is then classified by walking the splitters stored as an implicit
+ * binary tree (node j's children are 2j and 2j+1), one comparison per
+ * level and no branches:
+ *     j = 2*j + (x > tree[j])
+ * The tree is a few hundred bytes, so it stays in L1.
+ *
+ * Duplicate keys would all land in one bucket and be sorted by one thread,
+ * so every splitter also gets an equality bucket: leaf b of the tree holds
+ * (s[b-1], s[b]], and 2b+(x == s[b]) splits that into the elements below
+ * s[b] (to be sorted) and the copies of s[b] (already sorted).  Repeated
+ * splitters are merged first, so a value that fills much of the sample
+ * gets one equality bucket and the other splitters stay useful.
+ *
+ * Per-thread bucket counts give every thread its own output range in each
+ * bucket, the elements move to tmp once, and each range bucket is sorted
+ * there with QSORT by whichever thread takes it.
+ */
+#define SAMPLE_OVERSAMPLE 64
+
+/* number of splitter tree leaves, a power of two so the tree is complete */
+static int sample_buckets(int nthreads)
+{
+	int k = 1;
+	while (k < nthreads)
+		k *= 2;
+	return k;
+}
+
+/* fills tree[j] and its subtree from splitters[lo..hi) */
+static void sample_build_tree(float *tree, int j, const float *splitters, int lo, int hi)
 {
-	int i, j = begin, k = mid;
-	for(i = begin; i<end; i++)
+	if (lo >= hi)
+		return;
+	int mid = (lo + hi) / 2;
+	tree[j] = splitters[mid];
+	sample_build_tree(tree, 2*j, splitters, lo, mid);
+	sample_build_tree(tree, 2*j+1, splitters, mid+1, hi);
+}
+
+/* bucket of x: 2*leaf, or 2*leaf+1 if x equals the leaf's splitter */
+static inline int sample_classify(const float *tree, const float *splitters, int levels, float x)
+{
+	int j = 1, l;
+	for (l=0; l<levels; l++)
+		j = 2*j + (x > tree[j]);
+	j -= 1 << levels;
+	return 2*j + (x == splitters[j]);
+}
+
+/* Sorts A[0..n) using tmp[0..n) and returns the buffer that holds the
+ * result: tmp, unless n is too small to split (then A).  *largest is set
+ * to the size of the largest bucket that needed sorting. */
+float *sample_sort(float *A, float *tmp, int n, long *largest)
+{
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	int k = sample_buckets(nthreads);
+	int levels = 0;
+	while ((1 << levels) < k)
+		levels++;
+
+	int num_samples = k * SAMPLE_OVERSAMPLE;
+	*largest = 0;
+	if (k == 1 || n < 2*num_samples) {
+		QSORT(float, A, n, inline_qs_cmpf);
+		*largest = n;
+		return A;
+	}
+
+	/* splitters from a sorted sample */
+	float *sample = (float *) malloc(num_samples * sizeof(float));
+	assert(sample != NULL);
+	unsigned long long lcg = 0x2545f4914f6cdd1dULL;
+	int i, m;
+	for (i=0; i<num_samples; i++) {
+		lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+		sample[i] = A[(lcg >> 33) % n];
+	}
+	QSORT(float, sample, num_samples, inline_qs_cmpf);
+
+	/* m distinct splitters, the rest repeat the last one (their leaves stay
+	   empty); the last leaf has no splitter, NAN equals nothing */
+	float splitters[k];
+	float tree[k];
+	m = 0;
+	for (i=0; i<k-1; i++) {
+		float s = sample[(i+1) * SAMPLE_OVERSAMPLE];
+		if (m == 0 || s != splitters[m-1])
+			splitters[m++] = s;
+	}
+	for (i=m; i<k-1; i++)
+		splitters[i] = splitters[m-1];
+	splitters[k-1] = NAN;
+	sample_build_tree(tree, 1, splitters, 0, k-1);
+	free(sample);
+
+	/* counts[t*stride + b]: thread t's elements in bucket b, rows padded
+	   to whole cache lines */
+	int num_buckets = 2*k;
+	int stride = (num_buckets + 7) / 8 * 8;
+	long *counts = NULL;
+	if (posix_memalign((void **) &counts, 64, sizeof(long) * stride * nthreads) != 0)
+		counts = NULL;
+	assert(counts != NULL);
+	long bucket_start[num_buckets+1];
+
+#pragma omp parallel
+{
+	int tid = 0, team = 1;
+#ifdef _OPENMP
+	tid = omp_get_thread_num();
+	team = omp_get_num_threads();
+#endif
+	long lo = (long) n * tid / team;
+	long hi = (long) n * (tid + 1) / team;
+	long *mine = &counts[tid * stride];
+	long pos[num_buckets];
+	long j;
+	int b, t;
+
+	for (b=0; b<num_buckets; b++)
+		mine[b] = 0;
+	for (j=lo; j<hi; j++)
+		mine[sample_classify(tree, splitters, levels, A[j])]++;
+#pragma omp barrier
+
+#pragma omp single
 	{
-		if(j<mid && (globC[j]<globC[k]|| k>=end))
-		{
-			globB[i] = globC[j];
-			j++;
-		}
-		else
-		{
-			globB[i] = globC[k];
-			k++;
+		bucket_start[0] = 0;
+		for (b=0; b<num_buckets; b++) {
+			long size = 0;
+			for (t=0; t<team; t++)
+				size += counts[t * stride + b];
+			bucket_start[b+1] = bucket_start[b] + size;
+			if (b % 2 == 0 && size > *largest)
+				*largest = size;
 		}
 	}
+
+	for (b=0; b<num_buckets; b++) {
+		pos[b] = bucket_start[b];
+		for (t=0; t<tid; t++)
+			pos[b] += counts[t * stride + b];
+	}
+	for (j=lo; j<hi; j++) {
+		float x = A[j];
+		tmp[pos[sample_classify(tree, splitters, levels, x)]++] = x;
+	}
+#pragma omp barrier
+
+	/* buckets aren't all the same size, hand them out one at a time; the
+	   equality buckets (odd b) are already sorted */
+#pragma omp for schedule(dynamic, 1)
+	for (b=0; b<num_buckets; b+=2) {
+		long first = bucket_start[b];
+		long size = bucket_start[b+1] - first;
+		QSORT(float, &tmp[first], size, inline_qs_cmpf);
+	}
 }
+
+	free(counts);
+	return tmp;
+}
+
+static int sample_sort_parallel(const float *A, const int n, const int num_iterations) {
+
+	int nthreads = 1;
 #ifdef _OPENMP
-void p_merge(int begin, int mid, int end)
+	nthreads = omp_get_max_threads();
+#endif
+	fprintf(stderr, "N %d\n", n);
+	fprintf(stderr, "Using parallel sample sort, %d buckets plus equality buckets\n", sample_buckets(nthreads));
+	fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
+
+	double avg_elt;
+	long largest = 0;
+
+	float *B, *tmp;
+	B = (float *) bench_alloc(n * sizeof(float));
+	assert(B != NULL);
+	tmp = (float *) bench_alloc(n * sizeof(float));
+	assert(tmp != NULL);
+
+	bench_t b;
+	bench_init(&b, "sample_sort_parallel", num_iterations);
+	/* two classify reads and the scatter write, then the bucket sorts */
+	bench_set_work(&b, 4.0*n*3, 0.0);
+
+	while (bench_next(&b)) {
+
+		int i;
+
+#pragma omp parallel for private(i)
+		for (i=0; i<n; i++) {
+			B[i] = A[i];
+			tmp[i] = 0;
+		}
+
+		double elt;
+		bench_start(&b);
+
+		float *sorted = sample_sort(B, tmp, n, &largest);
+
+		elt = bench_stop(&b);
+		fprintf(stderr, "%9.3lf\n", elt*1e3);
+
+		/* correctness check */
+		for (i=1; i<n; i++) {
+			assert(sorted[i] >= sorted[i-1]);
+		}
+
+	}
+
+	avg_elt = bench_mean(&b);
+
+	bench_free(B);
+	bench_free(tmp);
+
+	fprintf(stderr, "Largest bucket to sort: %ld elements, %.2lf times the average\n",
+			largest, (double) largest * sample_buckets(nthreads) / n);
+	fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
+	fprintf(stderr, "Average sort rate: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+	bench_report(&b);
+	bench_destroy(&b);
+	return 0;
+
+}
+
+/* below this many elements a task sorts its range itself */
+#define MERGESORT_GRAIN 16384
+
+/* leaves this small use insertion sort, bigger ones QSORT */
+#define MERGESORT_INSERTION 32
+
+/* what mergesort() records, for the runner */
+typedef struct {
+	ppt_long_t merged;   /* elements merged by each thread */
+	ppt_long_t tasks;    /* tasks created by each thread */
+	ppt_double_t busy;   /* seconds each thread spent sorting and merging */
+} mergesort_stats_t;
+
+static void mergesort_stats_init(mergesort_stats_t *stats, int nthreads)
 {
-	int i, j = begin, k = mid;
+	ppt_long_init(&stats->merged, nthreads, 0, PPT_LINE);
+	ppt_long_init(&stats->tasks, nthreads, 0, PPT_LINE);
+	ppt_double_init(&stats->busy, nthreads, 0.0, PPT_LINE);
+}
 
-	// take the two halfs and into two threads
-	// let them respectively find the highest and lowest values of the two halfs
-	
-	//top
-	#pragma omp task private(i, j, k)
+static void mergesort_stats_reset(mergesort_stats_t *stats)
+{
+	int t;
+	for(t = 0; t<stats->merged.count; t++)
 	{
-		j = mid-1; 
-		k = end-1;
+		*ppt_long_slot(&stats->merged, t) = 0;
+		*ppt_long_slot(&stats->tasks, t) = 0;
+		*ppt_double_slot(&stats->busy, t) = 0.0;
+	}
+}
 
-		for(i = end-mid-1; i>=0; i--)
-		{
-			if(j>begin && (globC[j]>globC[k] || k<=mid))
-			{
-				top[i] = globC[j];
-				j--;
-			}
-			else
-			{
-				top[i] = globC[k];
-				k--;
-			}
-		}
+static void mergesort_stats_destroy(mergesort_stats_t *stats)
+{
+	ppt_long_destroy(&stats->merged);
+	ppt_long_destroy(&stats->tasks);
+	ppt_double_destroy(&stats->busy);
+}
+
+static void insertion_sort(float *A, int n)
+{
+	int i, j;
+	for(i = 1; i<n; i++)
+	{
+		float x = A[i];
+		for(j = i; j>0 && A[j-1]>x; j--)
+			A[j] = A[j-1];
+		A[j] = x;
 	}
-	// bot
-	#pragma omp task private(i, j, k)
+}
+
+/* Merge path: the first d outputs of merging a[0..na) and b[0..nb) are
+ * a[0..i) and b[0..d-i) for the i returned here, the smallest one with
+ * b[d-i-1] < a[i] (ties go to a).  That is a binary search along the d-th
+ * anti-diagonal of the a x b grid. */
+static int merge_corank(int d, const float *a, int na, const float *b, int nb)
+{
+	int lo = (d > nb) ? d - nb : 0;
+	int hi = (d < na) ? d : na;
+	while (lo < hi)
 	{
-		j = begin;
-		k = mid;
-		for(i = 0; i<mid-begin; i++)
+		int i = (lo + hi) / 2;
+		if (b[d-i-1] < a[i])
+			hi = i;
+		else
+			lo = i + 1;
+	}
+	return lo;
+}
+
+/* Merges src[begin..mid) and src[mid..end) into dst[begin..end) in one
+ * task per thread of the team, but at most one per grain elements, so
+ * only the merges near the top of the sort use the whole machine.  Each
+ * task takes an equal share of the output, finds where that share starts
+ * and ends in the two inputs with merge_corank and merges it straight
+ * into dst. */
+static void merge_path(const float *src, int begin, int mid, int end, float *dst,
+		int grain, mergesort_stats_t *stats)
+{
+	int parts = 1, p;
+#ifdef _OPENMP
+	parts = omp_get_num_threads();
+#endif
+	if (parts > (end - begin) / grain)
+		parts = (end - begin) / grain;
+	if (parts < 1)
+		parts = 1;
+	const float *a = &src[begin];
+	const float *b = &src[mid];
+	int na = mid - begin, nb = end - mid, n = end - begin;
+
+	for(p = 0; p<parts; p++)
+	{
+#ifdef _OPENMP
+		#pragma omp task firstprivate(p)
+#endif
 		{
-			if(j<mid && (globC[j]<globC[k] || k>=end))
+			int d0 = (int) ((long) n * p / parts);
+			int d1 = (int) ((long) n * (p+1) / parts);
+			int i0 = merge_corank(d0, a, na, b, nb);
+			int i1 = merge_corank(d1, a, na, b, nb);
+			int j0 = d0 - i0, j1 = d1 - i1;
+			int k = begin + d0;
+			double t0 = bench_now();
+
+			while(i0<i1 && j0<j1)
 			{
-				bot[i] = globC[j];
-				j++;
+				if(a[i0] <= b[j0])
+					dst[k++] = a[i0++];
+				else
+					dst[k++] = b[j0++];
 			}
-			else
+			while(i0<i1)
+				dst[k++] = a[i0++];
+			while(j0<j1)
+				dst[k++] = b[j0++];
+
+			if (stats != NULL)
 			{
-				bot[i] = globC[k];
-				k++;
+				*ppt_long_local(&stats->merged) += d1 - d0;
+				*ppt_double_local(&stats->busy) += bench_now() - t0;
 			}
-			
 		}
 	}
+	if (stats != NULL)
+		*ppt_long_local(&stats->tasks) += parts;
+#ifdef _OPENMP
 	#pragma omp taskwait
-	{
-		// Copy the bottom and top to globB
-	
-		// top
-		#pragma omp parallel for private(i)
-		for(i = mid; i<end; i++)
-		{
-			globB[i] = top[i - mid];
-		}
-
-		// bot
-		#pragma omp parallel for private(i)
-		for(i = begin; i<mid; i++)
-		{
-			globB[i] = bot[i - begin];
-		}
-	}
-}
 #endif
+}
 
-void mergesort(int begin, int end)
+/* Sorts src[begin..end) into src or dst, alternating by level: a call
+ * that has to leave its result in dst sorts both halves into src and
+ * merges them across, and the other way around, so every level moves the
+ * data once and nothing is copied back.  Ranges under grain elements are
+ * sorted in place by the task that gets them, so there are about 2n/grain
+ * tasks rather than one per element. */
+static void mergesort_rec(float *src, float *dst, int begin, int end, int into_dst,
+		int grain, mergesort_stats_t *stats)
 {
-	if(end-begin < 2)
+	int n = end - begin;
+	if(n < grain || n < 2)
+	{
+		double t0 = bench_now();
+		float *leaf = into_dst ? &dst[begin] : &src[begin];
+		if(into_dst)
+			memcpy(leaf, &src[begin], n * sizeof(float));
+		if(n <= MERGESORT_INSERTION)
+			insertion_sort(leaf, n);
+		else
+			QSORT(float, leaf, n, inline_qs_cmpf);
+		if (stats != NULL)
+			*ppt_double_local(&stats->busy) += bench_now() - t0;
 		return;
+	}
 
 	int mid = (begin+end)/2;
+	float *from = into_dst ? src : dst;
+	float *to = into_dst ? dst : src;
 #ifdef _OPENMP
 	#pragma omp task
 #endif
-	mergesort(begin, mid);
+	mergesort_rec(src, dst, begin, mid, !into_dst, grain, stats);
 #ifdef _OPENMP
 	#pragma omp task
 #endif
-	mergesort(mid, end);
+	mergesort_rec(src, dst, mid, end, !into_dst, grain, stats);
+	if (stats != NULL)
+		*ppt_long_local(&stats->tasks) += 2;
+	/* the merge reads both halves */
+#ifdef _OPENMP
+	#pragma omp taskwait
+#endif
+
+	merge_path(from, begin, mid, end, to, grain, stats);
+}
 
-	//#pragma omp taskwait
+/* Sorts A[0..n) with scratch[0..n) as the other buffer, splitting into
+ * tasks down to grain elements (MERGESORT_GRAIN if grain <= 0).  Keeps no
+ * state of its own, so concurrent calls on different arrays are fine.
+ * Called outside a parallel region it starts one; inside one, its tasks
+ * run on the current team.  stats may be NULL; its counters are added to. */
+void mergesort(float *A, float *scratch, int n, int grain, mergesort_stats_t *stats)
+{
+	if (grain <= 0)
+		grain = MERGESORT_GRAIN;
 #ifdef _OPENMP
-	if(end-begin >= 1024)
-		p_merge(begin, mid, end);
-	else 
-		merge(begin, mid, end);
-#else
-	merge(begin, mid, end);
+	if (!omp_in_parallel())
+	{
+		#pragma omp parallel
+		{
+			bench_topo_pin();
+			#pragma omp single
+			mergesort_rec(A, scratch, 0, n, 0, grain, stats);
+		}
+		return;
+	}
 #endif
-	copyArray( globB, globC, begin, end);
+	mergesort_rec(A, scratch, 0, n, 0, grain, stats);
 }
 
-void mergesortRunner(int begin, int end, int num_iterations)
+void mergesortRunner(const float *A, int n, int grain, int num_iterations)
 {
-	fprintf(stderr, "N %d\n", end);
-	fprintf(stderr, "parallel mergesort\n");
-	fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+	if (grain <= 0)
+		grain = MERGESORT_GRAIN;
+	fprintf(stderr, "N %d\n", n);
+	fprintf(stderr, "parallel mergesort, grain %d\n", grain);
+	fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
 	double avg_elt;
-	avg_elt = 0.0;
 
+	bench_t b;
+	bench_init(&b, "mergesort", num_iterations);
+	bench_set_work(&b, 4.0*n, 0.0);
 
-	globC = (float *) malloc(end * sizeof(float));
-	assert(globB != NULL);
+	float *B = (float *) bench_alloc(n * sizeof(float));
+	assert(B != NULL);
+	float *scratch = (float *) bench_alloc(n * sizeof(float));
+	assert(scratch != NULL);
 
-	int i = 0;
-	for(i=0; i<num_iterations; i++)
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	mergesort_stats_t stats;
+	mergesort_stats_init(&stats, nthreads);
+	double elt = 0.0;
+
+	while (bench_next(&b))
 	{
 		int j;
-		for(j = 0; j<end; j++)
-			globC[j] = globA[j];
-
-		double elt;
-		elt = timer();
+		for(j = 0; j<n; j++)
+			B[j] = A[j];
+		mergesort_stats_reset(&stats);
 
-		mergesort(begin, end);
+		bench_start(&b);
 
-		//printArray(globB, end);
-		//printArray(globC, end);
+		mergesort(B, scratch, n, grain, &stats);
 
-		elt = timer() - elt;
-		avg_elt += elt;
+		elt = bench_stop(&b);
 		fprintf(stderr, "%9.3lf\n", elt*1e3);
 
 		/* correctness check */
 		int k; 
-		for (k=1; k<end; k++) 
+		for (k=1; k<n; k++) 
 		{
-			assert(globB[k] >= globB[k-1]);
+			assert(B[k] >= B[k-1]);
 		}
 	}
 
-	avg_elt = avg_elt/num_iterations;
+	avg_elt = bench_mean(&b);
+
+	int t;
+	long total = ppt_long_combine(&stats.merged);
+	fprintf(stderr, "Elements merged per thread (last run, %ld total):", total);
+	for(t = 0; t<nthreads; t++)
+		fprintf(stderr, " %ld", *ppt_long_slot(&stats.merged, t));
+	fprintf(stderr, "\n");
+	/* idle: thread time in the sort that went to neither a leaf nor a merge */
+	double busy = ppt_double_combine(&stats.busy);
+	fprintf(stderr, "Tasks created (last run): %ld, idle: %.1lf%% of %d threads x %.3lf ms\n",
+			ppt_long_combine(&stats.tasks), 100.0*(1.0 - busy/(nthreads*elt)), nthreads, elt*1e3);
+	mergesort_stats_destroy(&stats);
 
-	free(globC);
+	bench_free(B);
+	bench_free(scratch);
 
 	fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
-	fprintf(stderr, "Average sort rate: %6.3lf MB/s\n", 4.0*end/(avg_elt*1e6));
+	fprintf(stderr, "Average sort rate: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+	bench_report(&b);
+	bench_destroy(&b);
 }
 
 /* generate different inputs for testing sort */
@@ -394,8 +932,11 @@ int gen_input(float *A, int n, int input_type) {
 
 int main(int argc, char **argv) {
 
-	if (argc != 4) {
-		fprintf(stderr, "%s <n> <input_type> <alg_type>\n", argv[0]);
+	bench_alloc_args(&argc, argv);
+	bench_harness_args(&argc, argv);
+
+	if (argc != 4 && argc != 5) {
+		fprintf(stderr, "%s <n> <input_type> <alg_type> [grain] [--alloc=<policy>] [harness flags]\n", argv[0]);
 		fprintf(stderr, "input_type 0: uniform random\n");
 		fprintf(stderr, "           1: already sorted\n");
 		fprintf(stderr, "           2: almost sorted\n");
@@ -404,6 +945,9 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "alg_type 0: use C qsort\n");
 		fprintf(stderr, "         1: use inline qsort\n");
 		fprintf(stderr, "         2: use mergesort\n");
+		fprintf(stderr, "         3: use parallel LSD radix sort\n");
+		fprintf(stderr, "         4: use parallel sample sort\n");
+		fprintf(stderr, "grain: smallest range the mergesort splits into tasks (default %d)\n", MERGESORT_GRAIN);
 		exit(1);
 	}
 
@@ -415,32 +959,23 @@ int main(int argc, char **argv) {
 	assert(n <= 1000000000);
 
 	float *A;
-	A = (float *) malloc(n * sizeof(float));
+	A = (float *) bench_alloc(n * sizeof(float));
 	assert(A != 0);
 
-	float *B = (float *) malloc(n * sizeof(float));
-	
+
 	int input_type = atoi(argv[2]);
 	assert(input_type >= 0);
 	assert(input_type <= 4);
 
 	gen_input(A, n, input_type);
-	gen_input(B, n, 3);
 
 	int alg_type = atoi(argv[3]);
+	int grain = (argc > 4) ? atoi(argv[4]) : MERGESORT_GRAIN;
+	assert(grain > 0);
 
 	int num_iterations = 10;
 
-	assert((alg_type == 0) || (alg_type == 1)|| (alg_type == 2));
-#ifdef _OPENMP
-#pragma omp parallel
-{
-#pragma omp task
-	top = (float *) malloc(n * sizeof(float));
-#pragma omp task
-	bot = (float *) malloc(n * sizeof(float));
-}
-#endif
+	assert((alg_type >= 0) && (alg_type <= 4));
 	if (alg_type == 0) 
 	{
 		qsort_serial(A, n, num_iterations);
@@ -451,19 +986,17 @@ int main(int argc, char **argv) {
 	}
 	else if (alg_type == 2) 
 	{
-		// n must be a power of 2 for parallel to work
-		assert(n%2 == 0);
-		globB = B;
-		globA = A;
-		//printArray(globB, n);
-		mergesortRunner(0, n, num_iterations);
+		mergesortRunner(A, n, grain, num_iterations);
+	}
+	else if (alg_type == 3)
+	{
+		radix_sort_parallel(A, n, num_iterations);
+	}
+	else if (alg_type == 4)
+	{
+		sample_sort_parallel(A, n, num_iterations);
 	}
 
-	free(A);
-	free(B);
-#ifdef _OPENMP
-	free(top);
-	free(bot);
-#endif
+	bench_free(A);
 	return 0;
 }
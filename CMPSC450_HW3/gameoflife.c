@@ -10,12 +10,7 @@
 #if USE_MPI
 #include <mpi.h>
 #endif
-
-static double timer() {
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-}
+#include "../common/bench_harness.h"
 
 void printGrid(int *grid, int m, int m_p)
 {
@@ -57,6 +52,8 @@ int main(int argc, char **argv) {
     num_tasks = 1;
 #endif
 
+    bench_harness_args(&argc, argv);
+
     if (argc != 3) {
         if (rank == 0) {
             fprintf(stderr, "%s <m> <k>\n", argv[0]);
@@ -147,9 +144,13 @@ if(rank == 0 || num_tasks == 1)
     MPI_Barrier(MPI_COMM_WORLD);
 #endif
 
+    /* counters are only read on rank 0, which reports */
     double elt = 0.0;
-    if (rank == 0) 
-        elt = timer();
+    double counts[BENCH_PERF_NUM_EVENTS];
+    if (rank == 0) {
+        bench_perf_start();
+        elt = bench_now();
+    }
 
 //#if USE_MPI
     /*PARALLEL MATMUL CODE START##########################################################*/
@@ -518,8 +519,10 @@ if(rank == 0 || num_tasks == 1)
 //     }
 // #endif
 
-    if (rank == 0) 
-        elt = timer() - elt;
+    if (rank == 0) {
+        elt = bench_now() - elt;
+        bench_perf_stop(counts);
+    }
 
     if(rank == 0)
     {
@@ -570,6 +573,15 @@ if(rank == 0 || num_tasks == 1)
     {
         fprintf(stderr, "time taken: %3.3lf s.\n", elt);
         fprintf(stderr, "Performance: %3.3lf billion cell updates/s\n", (1.0*m*m)*k/(elt*1e9));
+
+        /* a single timed run; repeating it would need every rank to agree
+           on when to stop, so the harness just records this one sample */
+        bench_t bench;
+        bench_init(&bench, "gameoflife", 1);
+        bench_record(&bench, elt);
+        bench_record_perf(&bench, counts);
+        bench_report(&bench);
+        bench_destroy(&bench);
     }
 
     /* free memory */
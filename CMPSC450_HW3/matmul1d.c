@@ -9,6 +9,7 @@
 #if USE_MPI
 #include <mpi.h>
 #endif
+#include "../common/bench_harness.h"
 
 // Given three NxN matrices A, B, and C, your task is to develop optimized serial and parallel versions of C = C + AB.
 // Fix N to 5000. Initialize values in matrices A, B, and C to random double-precision floating-point values in [0, 1]. 
@@ -48,13 +49,6 @@ void printMatrix(float *A, int n, int n_p)
 	}
 }
 
-static double timer() 
-{
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-}
-
 int main(int argc, char **argv) 
 {
 
@@ -73,6 +67,8 @@ int main(int argc, char **argv)
     num_tasks = 1;
 #endif
 
+    bench_harness_args(&argc, argv);
+
     if (argc != 2) 
     {
         if (rank == 0) 
@@ -146,9 +142,13 @@ int main(int argc, char **argv)
     MPI_Barrier(MPI_COMM_WORLD);
 #endif
 
+    /* counters are only read on rank 0, which reports */
     double elt = 0.0;
-    if (rank == 0) 
-        elt = timer();
+    double counts[BENCH_PERF_NUM_EVENTS];
+    if (rank == 0) {
+        bench_perf_start();
+        elt = bench_now();
+    }
 
 /*PARALLEL MATMUL CODE START##########################################################*/
 #if USE_MPI
@@ -234,8 +234,10 @@ int main(int argc, char **argv)
     }
 #endif
 
-    if (rank == 0) 
-        elt = timer() - elt;
+    if (rank == 0) {
+        elt = bench_now() - elt;
+        bench_perf_stop(counts);
+    }
 
     /* Verify */
     int verify_failed = 0;
@@ -262,6 +264,15 @@ int main(int argc, char **argv)
     {
         fprintf(stderr, "Time taken: %3.3lf s.\n", elt);
         fprintf(stderr, "Performance: %3.3lf GFlop/s\n", (2.0*n*n)*n/(elt*1e9));
+
+        /* single timed run, see gameoflife.c */
+        bench_t bench;
+        bench_init(&bench, "matmul1d", 1);
+        bench_set_work(&bench, 0.0, 2.0*n*n*n);
+        bench_record(&bench, elt);
+        bench_record_perf(&bench, counts);
+        bench_report(&bench);
+        bench_destroy(&bench);
     }
 
     /* free memory */
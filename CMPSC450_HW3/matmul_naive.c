@@ -3,19 +3,16 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <time.h>
-
-static double timer() {
-    
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-}
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
 
 int main(int argc, char **argv) {
 
+    bench_alloc_args(&argc, argv);
+    bench_harness_args(&argc, argv);
+
     if (argc != 2) {
-        fprintf(stderr, "%s <n>\n", argv[0]);
+        fprintf(stderr, "%s <n> [--alloc=<policy>] [harness flags]\n", argv[0]);
         fprintf(stderr, "<n>: matrix dimension (nxn dense matrices are created)\n");
         exit(1);
     }
@@ -31,11 +28,11 @@ int main(int argc, char **argv) {
 
     double *A, *B, *C;
     
-    A = (double *) malloc(n * n * sizeof(double));
+    A = (double *) bench_alloc(n * n * sizeof(double));
     assert(A != 0);
-    B = (double *) malloc(n * n * sizeof(double));
+    B = (double *) bench_alloc(n * n * sizeof(double));
     assert(B != 0);
-    C = (double *) malloc(n * n * sizeof(double));
+    C = (double *) bench_alloc(n * n * sizeof(double));
     assert(C != 0);
 
 
@@ -55,21 +52,26 @@ int main(int argc, char **argv) {
         }
     }
 
-    double elt = 0.0;
-    elt = timer();
+    bench_t b;
+    bench_init(&b, "matmul_naive", 1);
+    bench_set_work(&b, 0.0, 2.0*n*n*n);
 
     int k;
-    for (i=0; i<n; i++) {
-        for (j=0; j<n; j++) {
-            double c_ij = 0;
-            for (k=0; k<n; k++) {
-                c_ij += A[i*n+k]*B[k*n+j];
+    while (bench_next(&b)) {
+        bench_start(&b);
+        for (i=0; i<n; i++) {
+            for (j=0; j<n; j++) {
+                double c_ij = 0;
+                for (k=0; k<n; k++) {
+                    c_ij += A[i*n+k]*B[k*n+j];
+                }
+                C[i*n+j] = c_ij;
             }
-            C[i*n+j] = c_ij;
         }
+        bench_stop(&b);
     }
 
-    elt = timer() - elt;
+    double elt = bench_stats(&b).median;
 
     /* Verify */
     int verify_failed = 0;
@@ -87,9 +89,11 @@ int main(int argc, char **argv) {
 
     fprintf(stderr, "Time taken: %3.3lf s.\n", elt);
     fprintf(stderr, "Performance: %3.3lf GFlop/s\n", (2.0*n*n*n)/(elt*1e9));
+    bench_report(&b);
+    bench_destroy(&b);
 
     /* free memory */
-    free(A); free(B); free(C);
+    bench_free(A); bench_free(B); bench_free(C);
 
     return 0;
 }
@@ -5,15 +5,7 @@
 #include <math.h>
 #include <string.h>
 #include <sys/time.h>
-
-static double timer() 
-{
-    
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-
-}
+#include "../common/bench_harness.h"
 
 int my_Allgather(int *sendbuf, int n, int nprocs, int *recvbuf, int rank) 
 {
@@ -63,6 +55,8 @@ int main(int argc, char **argv)
     MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+    bench_harness_args(&argc, argv);
+
     /* change the input size here */
     int n;
     if (argc == 2) 
@@ -95,15 +89,18 @@ int main(int argc, char **argv)
     recvbuf2 = (int *) malloc(n*nprocs*sizeof(int));
     assert(recvbuf2 != 0);
 
+    /* counters are only read on rank 0, which reports */
+    double countsStd[BENCH_PERF_NUM_EVENTS], countsCustom[BENCH_PERF_NUM_EVENTS];
+
     double allGatherStd = 0.0;
-    if (rank == 0) allGatherStd = timer();
+    if (rank == 0) { bench_perf_start(); allGatherStd = bench_now(); }
     MPI_Allgather(sendbuf, n, MPI_INT, recvbuf1, n, MPI_INT, MPI_COMM_WORLD);
-    if (rank == 0) allGatherStd = timer() - allGatherStd;
+    if (rank == 0) { allGatherStd = bench_now() - allGatherStd; bench_perf_stop(countsStd); }
 
     double allGatherCustom = 0.0;
-    if (rank == 0) allGatherCustom = timer();
+    if (rank == 0) { bench_perf_start(); allGatherCustom = bench_now(); }
     my_Allgather(sendbuf, n, nprocs, recvbuf2, rank);
-    if (rank == 0) allGatherCustom = timer() - allGatherCustom;
+    if (rank == 0) { allGatherCustom = bench_now() - allGatherCustom; bench_perf_stop(countsCustom); }
     
     /* verify that my_Allgather works correctly */
     for (i=0; i<n*nprocs; i++) {
@@ -119,6 +116,22 @@ int main(int argc, char **argv)
     if (rank == 0) {
         printf("Elapsed time (standard) : %9.6lf s\n", allGatherStd);
         printf("Elapsed time (custom)   : %9.6lf s\n", allGatherCustom);
+
+        /* single timed runs, see gameoflife.c */
+        bench_t bench;
+        bench_init(&bench, "MPI_Allgather", 1);
+        bench_set_work(&bench, 4.0*n*nprocs, 0.0);
+        bench_record(&bench, allGatherStd);
+        bench_record_perf(&bench, countsStd);
+        bench_report(&bench);
+        bench_destroy(&bench);
+
+        bench_init(&bench, "my_Allgather", 1);
+        bench_set_work(&bench, 4.0*n*nprocs, 0.0);
+        bench_record(&bench, allGatherCustom);
+        bench_record_perf(&bench, countsCustom);
+        bench_report(&bench);
+        bench_destroy(&bench);
     }
 
     return 0;
@@ -0,0 +1,263 @@
+/* Shared allocator for the array benchmarks.
+ *
+ * Every benchmark used to call plain malloc().  This header lets the
+ * allocation policy be picked on the command line so the effect of huge
+ * pages, NUMA placement and alignment can be measured without editing the
+ * benchmark:
+ *
+ *   --alloc=malloc      plain malloc (default)
+ *   --alloc=line        64-byte (cache line) aligned
+ *   --alloc=page        4 KB (page) aligned
+ *   --alloc=thp         2 MB aligned + madvise(MADV_HUGEPAGE)
+ *   --alloc=hugetlb     mmap(MAP_HUGETLB), needs reserved huge pages
+ *                       (falls back to thp when none are available)
+ *   --alloc=interleave  mbind(MPOL_INTERLEAVE) over all online nodes
+ *   --alloc=local       mbind(MPOL_LOCAL): first-touch on the touching
+ *                       thread's node, even under numactl --interleave
+ *
+ * Usage:
+ *   #include "../common/bench_alloc.h"
+ *   bench_alloc_args(&argc, argv);     (strips --alloc=... from argv)
+ *   int *A = (int *) bench_alloc(n * sizeof(int));
+ *   ...
+ *   bench_free(A);
+ *
+ * Pages are never touched here, so the benchmark's own initialization
+ * loop still decides where first-touch places them.
+ */
+#ifndef BENCH_ALLOC_H
+#define BENCH_ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define BENCH_LINE_SIZE   64
+#define BENCH_PAGE_SIZE   4096
+#define BENCH_HUGE_SIZE   (2UL << 20)
+
+/* from <linux/mempolicy.h>, spelled out so we don't need libnuma */
+#define BENCH_MPOL_INTERLEAVE 3
+#define BENCH_MPOL_LOCAL      4
+#define BENCH_MAX_NODES       1024
+
+enum {
+    BENCH_ALLOC_MALLOC,
+    BENCH_ALLOC_LINE,
+    BENCH_ALLOC_PAGE,
+    BENCH_ALLOC_THP,
+    BENCH_ALLOC_HUGETLB,
+    BENCH_ALLOC_INTERLEAVE,
+    BENCH_ALLOC_LOCAL,
+    BENCH_ALLOC_NUM_POLICIES
+};
+
+static const char *bench_alloc_names[BENCH_ALLOC_NUM_POLICIES] = {
+    "malloc", "line", "page", "thp", "hugetlb", "interleave", "local"
+};
+
+static int bench_alloc_policy = BENCH_ALLOC_MALLOC;
+
+/* MAP_HUGETLB regions must be munmap'ed with their length, so remember
+   them; everything else is released with free() */
+#define BENCH_MAX_MAPPINGS 64
+
+static struct {
+    void *ptr;
+    size_t bytes;
+} bench_mappings[BENCH_MAX_MAPPINGS];
+
+/* Remove --alloc=<policy> from argv so the benchmark's positional argument
+   checks are unchanged.  Exits on an unknown policy. */
+static inline void bench_alloc_args(int *argc, char **argv)
+{
+    int i, j = 1;
+    for (i=1; i<*argc; i++) {
+        if (strncmp(argv[i], "--alloc=", 8) != 0) {
+            argv[j++] = argv[i];
+            continue;
+        }
+
+        const char *name = argv[i] + 8;
+        int p;
+        for (p=0; p<BENCH_ALLOC_NUM_POLICIES; p++) {
+            if (strcmp(name, bench_alloc_names[p]) == 0)
+                break;
+        }
+        if (p == BENCH_ALLOC_NUM_POLICIES) {
+            fprintf(stderr, "unknown allocation policy %s, use one of:", name);
+            for (p=0; p<BENCH_ALLOC_NUM_POLICIES; p++)
+                fprintf(stderr, " %s", bench_alloc_names[p]);
+            fprintf(stderr, "\n");
+            exit(1);
+        }
+        bench_alloc_policy = p;
+        fprintf(stderr, "Allocation policy: %s\n", name);
+    }
+    *argc = j;
+    argv[j] = NULL;
+}
+
+/* Parse /sys/devices/system/node/online ("0", "0-3", "0,2-3") into a
+   bitmask.  Returns the number of bits needed, 0 if the file is missing. */
+static inline unsigned long bench_online_nodes(unsigned long *mask, int mask_words)
+{
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (f == NULL)
+        return 0;
+
+    unsigned long maxnode = 0;
+    int lo, hi;
+    char sep;
+    memset(mask, 0, mask_words * sizeof(unsigned long));
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        sep = (char) fgetc(f);
+        if (sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1)
+                break;
+            sep = (char) fgetc(f);
+        }
+        int node;
+        for (node=lo; node<=hi && node<mask_words*64; node++) {
+            mask[node/64] |= 1UL << (node%64);
+            if ((unsigned long) node + 1 > maxnode)
+                maxnode = node + 1;
+        }
+        if (sep != ',')
+            break;
+    }
+    fclose(f);
+
+    return maxnode;
+}
+
+static inline int bench_mbind(void *ptr, size_t bytes, int mode)
+{
+    unsigned long mask[BENCH_MAX_NODES/64];
+    unsigned long maxnode = 0;
+
+    if (mode == BENCH_MPOL_INTERLEAVE) {
+        maxnode = bench_online_nodes(mask, BENCH_MAX_NODES/64);
+        if (maxnode == 0)
+            return -1;
+        /* the kernel ignores the top bit of maxnode */
+        maxnode++;
+    }
+
+    return (int) syscall(SYS_mbind, ptr, bytes, mode,
+                         maxnode ? mask : NULL, maxnode, 0);
+}
+
+static inline void *bench_memalign(size_t align, size_t bytes)
+{
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, align, bytes) != 0)
+        return NULL;
+    return ptr;
+}
+
+/* Allocate bytes with the selected policy and at least min_align alignment
+   (0 for no requirement beyond malloc's).  Returns NULL on failure, like
+   malloc. */
+static inline void *bench_alloc_aligned(size_t bytes, size_t min_align)
+{
+    void *ptr;
+    size_t align = min_align;
+
+    switch (bench_alloc_policy) {
+
+    case BENCH_ALLOC_LINE:
+        if (align < BENCH_LINE_SIZE)
+            align = BENCH_LINE_SIZE;
+        return bench_memalign(align, bytes);
+
+    case BENCH_ALLOC_PAGE:
+        if (align < BENCH_PAGE_SIZE)
+            align = BENCH_PAGE_SIZE;
+        return bench_memalign(align, bytes);
+
+    case BENCH_ALLOC_HUGETLB: {
+        size_t rounded = (bytes + BENCH_HUGE_SIZE - 1) & ~(BENCH_HUGE_SIZE - 1);
+        ptr = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            int i, slot = -1;
+#ifdef _OPENMP
+#pragma omp critical (bench_alloc_mappings)
+#endif
+            for (i=0; i<BENCH_MAX_MAPPINGS; i++) {
+                if (bench_mappings[i].ptr == NULL) {
+                    bench_mappings[i].ptr = ptr;
+                    bench_mappings[i].bytes = rounded;
+                    slot = i;
+                    break;
+                }
+            }
+            if (slot >= 0)
+                return ptr;
+            munmap(ptr, rounded);
+            return NULL;
+        }
+        fprintf(stderr, "MAP_HUGETLB failed for %zu bytes, falling back to thp\n", bytes);
+    }
+    /* fall through */
+    case BENCH_ALLOC_THP: {
+        size_t rounded = (bytes + BENCH_HUGE_SIZE - 1) & ~(BENCH_HUGE_SIZE - 1);
+        ptr = bench_memalign(BENCH_HUGE_SIZE > align ? BENCH_HUGE_SIZE : align, rounded);
+        if (ptr != NULL && madvise(ptr, rounded, MADV_HUGEPAGE) != 0)
+            fprintf(stderr, "madvise(MADV_HUGEPAGE) failed, using base pages\n");
+        return ptr;
+    }
+
+    case BENCH_ALLOC_INTERLEAVE:
+    case BENCH_ALLOC_LOCAL: {
+        int mode = (bench_alloc_policy == BENCH_ALLOC_INTERLEAVE)
+                   ? BENCH_MPOL_INTERLEAVE : BENCH_MPOL_LOCAL;
+        size_t rounded = (bytes + BENCH_PAGE_SIZE - 1) & ~((size_t) BENCH_PAGE_SIZE - 1);
+        ptr = bench_memalign(BENCH_PAGE_SIZE > align ? BENCH_PAGE_SIZE : align, rounded);
+        if (ptr != NULL && bench_mbind(ptr, rounded, mode) != 0)
+            fprintf(stderr, "mbind(%s) failed, using the default policy\n",
+                    bench_alloc_names[bench_alloc_policy]);
+        return ptr;
+    }
+
+    default:
+        if (align > 0)
+            return bench_memalign(align, bytes);
+        return malloc(bytes);
+    }
+}
+
+static inline void *bench_alloc(size_t bytes)
+{
+    return bench_alloc_aligned(bytes, 0);
+}
+
+static inline void bench_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    int i;
+    size_t bytes = 0;
+#ifdef _OPENMP
+#pragma omp critical (bench_alloc_mappings)
+#endif
+    for (i=0; i<BENCH_MAX_MAPPINGS; i++) {
+        if (bench_mappings[i].ptr == ptr) {
+            bytes = bench_mappings[i].bytes;
+            bench_mappings[i].ptr = NULL;
+            break;
+        }
+    }
+    if (bytes > 0)
+        munmap(ptr, bytes);
+    else
+        free(ptr);
+}
+
+#endif
@@ -0,0 +1,390 @@
+/* Shared benchmark harness.
+ *
+ * Replaces the timer() function that every benchmark used to carry its own
+ * copy of (mostly gettimeofday() with microsecond resolution) and the
+ * "run num_iterations times, print the average" loops:
+ *
+ *  - bench_now() reads CLOCK_MONOTONIC_RAW, which has ns resolution and is
+ *    not slewed by NTP
+ *  - warmup runs are executed but not recorded
+ *  - after the minimum number of repetitions the loop keeps going until
+ *    the 95% confidence interval of the mean is within --rel-ci of the
+ *    mean, or until --max-reps / --max-time is hit
+ *  - min, median, p90, p99, mean and the CI are reported on stderr, and
+ *    with --format=csv or --format=json one record per timed region is
+ *    written to stdout for dashboards
+ *
+ * Usage:
+ *   #include "../common/bench_harness.h"      (link with -lm)
+ *   bench_harness_args(&argc, argv);   (strips the flags below from argv)
+ *
+ *   bench_t b;
+ *   bench_init(&b, "sum_serial", num_iterations);
+ *   bench_set_work(&b, 4.0*n, 0.0);    (bytes and flops per repetition)
+ *   while (bench_next(&b)) {
+ *       ... untimed setup ...
+ *       bench_start(&b);
+ *       ... timed region ...
+ *       double elt = bench_stop(&b);
+ *   }
+ *   bench_report(&b);
+ *   bench_destroy(&b);
+ *
+ * Regions that can't be put in a loop (e.g. a single MPI run) can time
+ * themselves with bench_now() and hand the result to bench_record(), and
+ * their bench_perf_start()/bench_perf_stop() counts to bench_record_perf().
+ *
+ * Flags:
+ *   --format=text|csv|json   machine-readable records on stdout (text)
+ *   --warmup=<n>             untimed runs before recording (1)
+ *   --min-reps=<n>           override every region's minimum repetitions
+ *   --max-reps=<n>           upper bound on recorded repetitions (1000)
+ *   --max-time=<s>           stop adapting after this much time (2.0)
+ *   --rel-ci=<x>             target CI half-width relative to mean (0.02)
+ *   --perf                   hardware counters per repetition (bench_perf.h)
+ *   --bind=<policy>          pin OpenMP threads: none, compact, scatter,
+ *                            core; the default-sized team and regions
+ *                            that call bench_topo_pin(), not nested
+ *                            teams (see bench_topo.h)
+ */
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "bench_perf.h"
+#include "bench_topo.h"
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+enum { BENCH_FORMAT_TEXT, BENCH_FORMAT_CSV, BENCH_FORMAT_JSON };
+
+static int bench_format = BENCH_FORMAT_TEXT;
+static int bench_warmup = 1;
+static int bench_min_reps = 0;
+static int bench_max_reps = 1000;
+static double bench_max_time = 2.0;
+static double bench_rel_ci = 0.02;
+static int bench_csv_header_done = 0;
+
+typedef struct {
+    const char *name;
+    int min_reps;
+    int warmup_left;
+    int count;
+    int capacity;
+    double *samples;
+    double started;
+    double first_sample;
+    double bytes;
+    double flops;
+    int perf_count;
+    double perf[BENCH_PERF_NUM_EVENTS];
+} bench_t;
+
+static inline double bench_now(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+    return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
+}
+
+/* Remove the harness flags from argv so the benchmark's positional
+   argument checks are unchanged. */
+static inline void bench_harness_args(int *argc, char **argv)
+{
+    int i, j = 1;
+    for (i=1; i<*argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--format=text") == 0) {
+            bench_format = BENCH_FORMAT_TEXT;
+        } else if (strcmp(a, "--format=csv") == 0) {
+            bench_format = BENCH_FORMAT_CSV;
+        } else if (strcmp(a, "--format=json") == 0) {
+            bench_format = BENCH_FORMAT_JSON;
+        } else if (strncmp(a, "--warmup=", 9) == 0) {
+            bench_warmup = atoi(a + 9);
+        } else if (strncmp(a, "--min-reps=", 11) == 0) {
+            bench_min_reps = atoi(a + 11);
+        } else if (strncmp(a, "--max-reps=", 11) == 0) {
+            bench_max_reps = atoi(a + 11);
+        } else if (strncmp(a, "--max-time=", 11) == 0) {
+            bench_max_time = atof(a + 11);
+        } else if (strncmp(a, "--rel-ci=", 9) == 0) {
+            bench_rel_ci = atof(a + 9);
+        } else if (strcmp(a, "--perf") == 0) {
+            bench_perf_enabled = 1;
+        } else if (bench_topo_flag(a)) {
+            /* placement policy set */
+        } else if (strncmp(a, "--format=", 9) == 0) {
+            fprintf(stderr, "unknown format %s, use text, csv or json\n", a + 9);
+            exit(1);
+        } else {
+            argv[j++] = argv[i];
+        }
+    }
+    *argc = j;
+    argv[j] = NULL;
+
+    bench_topo_setup();
+    if (bench_warmup < 0)
+        bench_warmup = 0;
+    if (bench_max_reps < 1)
+        bench_max_reps = 1;
+}
+
+/* min_reps is the number of repetitions the benchmark used to run; the
+   loop never stops before that (unless --max-reps is smaller) */
+static inline void bench_init(bench_t *b, const char *name, int min_reps)
+{
+    b->name = name;
+    b->min_reps = (bench_min_reps > 0) ? bench_min_reps : min_reps;
+    if (b->min_reps < 1)
+        b->min_reps = 1;
+    if (b->min_reps > bench_max_reps)
+        b->min_reps = bench_max_reps;
+    b->warmup_left = bench_warmup;
+    b->count = 0;
+    b->capacity = 0;
+    b->samples = NULL;
+    b->started = 0.0;
+    b->first_sample = 0.0;
+    b->bytes = 0.0;
+    b->flops = 0.0;
+    b->perf_count = 0;
+    memset(b->perf, 0, sizeof(b->perf));
+}
+
+static inline void bench_destroy(bench_t *b)
+{
+    free(b->samples);
+    b->samples = NULL;
+    b->count = b->capacity = 0;
+}
+
+/* bytes moved and floating point operations per repetition, used to
+   derive GB/s and GFlop/s in the report (0 to leave out) */
+static inline void bench_set_work(bench_t *b, double bytes, double flops)
+{
+    b->bytes = bytes;
+    b->flops = flops;
+}
+
+static inline void bench_record(bench_t *b, double elt)
+{
+    if (b->count == 0)
+        b->first_sample = bench_now();
+    if (b->count == b->capacity) {
+        b->capacity = b->capacity ? 2*b->capacity : 64;
+        b->samples = (double *) realloc(b->samples, b->capacity * sizeof(double));
+        if (b->samples == NULL) {
+            fprintf(stderr, "bench_record: out of memory\n");
+            exit(1);
+        }
+    }
+    b->samples[b->count++] = elt;
+}
+
+/* add one repetition's counter totals (from bench_perf_stop()) */
+static inline void bench_record_perf(bench_t *b, const double *counts)
+{
+    int e;
+    if (!bench_perf_enabled)
+        return;
+    for (e=0; e<BENCH_PERF_NUM_EVENTS; e++)
+        b->perf[e] += counts[e];
+    b->perf_count++;
+}
+
+static inline double bench_mean(const bench_t *b)
+{
+    double sum = 0.0;
+    int i;
+    for (i=0; i<b->count; i++)
+        sum += b->samples[i];
+    return b->count ? sum/b->count : 0.0;
+}
+
+/* half-width of the 95% confidence interval of the mean (Student t) */
+static inline double bench_ci95(const bench_t *b)
+{
+    static const double t95[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    int n = b->count;
+    if (n < 2)
+        return 0.0;
+
+    double mean = bench_mean(b);
+    double ss = 0.0;
+    int i;
+    for (i=0; i<n; i++)
+        ss += (b->samples[i] - mean) * (b->samples[i] - mean);
+    double stddev = sqrt(ss/(n-1));
+    double t = (n-1 <= 30) ? t95[n-2] : 1.960;
+    return t * stddev / sqrt((double) n);
+}
+
+/* Loop condition: true while another repetition (warmup or recorded)
+   should run. */
+static inline int bench_next(bench_t *b)
+{
+    if (b->warmup_left > 0)
+        return 1;
+    if (b->count < b->min_reps)
+        return 1;
+    if (b->count >= bench_max_reps)
+        return 0;
+    if (bench_now() - b->first_sample >= bench_max_time)
+        return 0;
+    if (b->count >= 3 && bench_ci95(b) <= bench_rel_ci * bench_mean(b))
+        return 0;
+    return 1;
+}
+
+static inline void bench_start(bench_t *b)
+{
+    bench_topo_bind();
+    bench_perf_start();
+    b->started = bench_now();
+}
+
+/* stop the clock, record the sample unless this was a warmup run, and
+   return the elapsed time in seconds */
+static inline double bench_stop(bench_t *b)
+{
+    double elt = bench_now() - b->started;
+    double counts[BENCH_PERF_NUM_EVENTS];
+    bench_perf_stop(counts);
+    if (b->warmup_left > 0) {
+        b->warmup_left--;
+    } else {
+        bench_record(b, elt);
+        bench_record_perf(b, counts);
+    }
+    return elt;
+}
+
+static inline int bench_cmp_double(const void *u, const void *v)
+{
+    double a = *(const double *) u, c = *(const double *) v;
+    return (a > c) - (a < c);
+}
+
+typedef struct {
+    int count;
+    double min, median, p90, p99, mean, ci95;
+} bench_stats_t;
+
+/* nearest-rank percentiles over the recorded samples */
+static inline bench_stats_t bench_stats(const bench_t *b)
+{
+    bench_stats_t s;
+    memset(&s, 0, sizeof(s));
+    s.count = b->count;
+    if (b->count == 0)
+        return s;
+
+    double *sorted = (double *) malloc(b->count * sizeof(double));
+    memcpy(sorted, b->samples, b->count * sizeof(double));
+    qsort(sorted, b->count, sizeof(double), bench_cmp_double);
+
+    int n = b->count;
+    s.min = sorted[0];
+    s.median = (n % 2) ? sorted[n/2] : 0.5*(sorted[n/2-1] + sorted[n/2]);
+    s.p90 = sorted[(int) ceil(0.90*n) - 1];
+    s.p99 = sorted[(int) ceil(0.99*n) - 1];
+    s.mean = bench_mean(b);
+    s.ci95 = bench_ci95(b);
+    free(sorted);
+
+    return s;
+}
+
+/* one summary line on stderr, plus a CSV/JSON record on stdout */
+static inline void bench_report(const bench_t *b)
+{
+    bench_stats_t s = bench_stats(b);
+
+    fprintf(stderr, "[%s] reps: %d, min: %.3lf ms, median: %.3lf ms, "
+            "p90: %.3lf ms, p99: %.3lf ms, mean: %.3lf +- %.3lf ms\n",
+            b->name, s.count, s.min*1e3, s.median*1e3, s.p90*1e3,
+            s.p99*1e3, s.mean*1e3, s.ci95*1e3);
+
+    /* counter averages per repetition */
+    double perf[BENCH_PERF_NUM_EVENTS];
+    int e;
+    for (e=0; e<BENCH_PERF_NUM_EVENTS; e++)
+        perf[e] = b->perf_count ? b->perf[e]/b->perf_count : 0.0;
+    if (bench_perf_enabled) {
+        fprintf(stderr, "[%s] per rep:", b->name);
+        for (e=0; e<BENCH_PERF_NUM_EVENTS; e++) {
+            if (bench_perf_available[e])
+                fprintf(stderr, "%s %s: %.0lf", e ? "," : "",
+                        bench_perf_names[e], perf[e]);
+            else
+                fprintf(stderr, "%s %s: n/a", e ? "," : "", bench_perf_names[e]);
+        }
+        if (bench_perf_available[BENCH_PERF_CYCLES] &&
+            bench_perf_available[BENCH_PERF_INSTRUCTIONS] &&
+            perf[BENCH_PERF_CYCLES] > 0)
+            fprintf(stderr, " (IPC %.2lf)",
+                    perf[BENCH_PERF_INSTRUCTIONS]/perf[BENCH_PERF_CYCLES]);
+        fprintf(stderr, "\n");
+    }
+
+    double gbs = (b->bytes > 0 && s.median > 0) ? b->bytes/(s.median*1e9) : 0.0;
+    double gflops = (b->flops > 0 && s.median > 0) ? b->flops/(s.median*1e9) : 0.0;
+
+    if (bench_format == BENCH_FORMAT_CSV) {
+        if (!bench_csv_header_done) {
+            printf("name,reps,min_s,median_s,p90_s,p99_s,mean_s,ci95_s,gb_per_s,gflop_per_s");
+            if (bench_perf_enabled) {
+                for (e=0; e<BENCH_PERF_NUM_EVENTS; e++)
+                    printf(",%s", bench_perf_names[e]);
+            }
+            printf("\n");
+            bench_csv_header_done = 1;
+        }
+        printf("%s,%d,%.9lf,%.9lf,%.9lf,%.9lf,%.9lf,%.9lf,%.6lf,%.6lf",
+               b->name, s.count, s.min, s.median, s.p90, s.p99, s.mean,
+               s.ci95, gbs, gflops);
+        if (bench_perf_enabled) {
+            /* unavailable counters are left empty */
+            for (e=0; e<BENCH_PERF_NUM_EVENTS; e++) {
+                if (bench_perf_available[e])
+                    printf(",%.0lf", perf[e]);
+                else
+                    printf(",");
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    } else if (bench_format == BENCH_FORMAT_JSON) {
+        printf("{\"name\": \"%s\", \"reps\": %d, \"min_s\": %.9lf, "
+               "\"median_s\": %.9lf, \"p90_s\": %.9lf, \"p99_s\": %.9lf, "
+               "\"mean_s\": %.9lf, \"ci95_s\": %.9lf, \"gb_per_s\": %.6lf, "
+               "\"gflop_per_s\": %.6lf",
+               b->name, s.count, s.min, s.median, s.p90, s.p99, s.mean,
+               s.ci95, gbs, gflops);
+        if (bench_perf_enabled) {
+            for (e=0; e<BENCH_PERF_NUM_EVENTS; e++) {
+                if (bench_perf_available[e])
+                    printf(", \"%s\": %.0lf", bench_perf_names[e], perf[e]);
+                else
+                    printf(", \"%s\": null", bench_perf_names[e]);
+            }
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+}
+
+#endif
@@ -0,0 +1,203 @@
+/* Hardware performance counters around timed regions.
+ *
+ * Opens a perf_event_open() group per thread with
+ *   cycles, instructions, LLC load misses, dTLB load misses, branch misses
+ * so a regression can be attributed to cache misses or mispredicts without
+ * attaching an external profiler.  Only user-space events are counted, so
+ * this works with the default perf_event_paranoid setting.
+ *
+ * perf events attached to a thread only count that thread, and inherited
+ * counters only fold a child's counts back in when it exits, which the
+ * OpenMP worker threads never do.  So every OpenMP thread opens its own
+ * group (lazily, the first time a region is measured with that many
+ * threads), and start/stop enable, disable and sum all of them from the
+ * master thread.
+ *
+ * The harness (bench_harness.h) calls bench_perf_start()/bench_perf_stop()
+ * around every timed region when --perf is given; code that times itself
+ * with bench_now() can call them directly:
+ *
+ *   double counts[BENCH_PERF_NUM_EVENTS];
+ *   bench_perf_start();
+ *   ... timed region ...
+ *   bench_perf_stop(counts);
+ */
+#ifndef BENCH_PERF_H
+#define BENCH_PERF_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BENCH_PERF_NUM_EVENTS 5
+#define BENCH_PERF_MAX_THREADS 256
+
+enum {
+    BENCH_PERF_CYCLES,
+    BENCH_PERF_INSTRUCTIONS,
+    BENCH_PERF_LLC_MISSES,
+    BENCH_PERF_DTLB_MISSES,
+    BENCH_PERF_BRANCH_MISSES
+};
+
+static const char *bench_perf_names[BENCH_PERF_NUM_EVENTS] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} bench_perf_events[BENCH_PERF_NUM_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int bench_perf_enabled = 0;
+static int bench_perf_fds[BENCH_PERF_MAX_THREADS][BENCH_PERF_NUM_EVENTS];
+static int bench_perf_opened[BENCH_PERF_MAX_THREADS];
+static int bench_perf_available[BENCH_PERF_NUM_EVENTS];
+static int bench_perf_warned = 0;
+static int bench_perf_errno = 0;
+
+static inline int bench_perf_open(int event, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = bench_perf_events[event].type;
+    attr.config = bench_perf_events[event].config;
+    attr.disabled = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* pid 0, cpu -1: the calling thread on whatever CPU it runs */
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* open the counter group for the calling thread in slot tid */
+static inline void bench_perf_open_thread(int tid)
+{
+    if (tid >= BENCH_PERF_MAX_THREADS || bench_perf_opened[tid])
+        return;
+
+    int e;
+    int leader = bench_perf_open(BENCH_PERF_CYCLES, -1);
+    if (leader < 0)
+        bench_perf_errno = errno;
+    bench_perf_fds[tid][BENCH_PERF_CYCLES] = leader;
+    for (e=1; e<BENCH_PERF_NUM_EVENTS; e++) {
+        int fd = -1;
+        if (leader >= 0)
+            fd = bench_perf_open(e, leader);
+        /* not every PMU (or VM) can schedule the whole group, so fall back
+           to a standalone counter rather than losing the event */
+        if (fd < 0)
+            fd = bench_perf_open(e, -1);
+        bench_perf_fds[tid][e] = fd;
+    }
+    bench_perf_opened[tid] = 1;
+}
+
+/* make sure every thread of the next parallel region has its counters */
+static inline void bench_perf_attach(void)
+{
+#ifdef _OPENMP
+    int want = omp_get_max_threads();
+    if (want > BENCH_PERF_MAX_THREADS)
+        want = BENCH_PERF_MAX_THREADS;
+    int missing = 0, t;
+    for (t=0; t<want; t++) {
+        if (!bench_perf_opened[t])
+            missing = 1;
+    }
+    if (missing) {
+#pragma omp parallel
+        bench_perf_open_thread(omp_get_thread_num());
+    }
+#else
+    bench_perf_open_thread(0);
+#endif
+
+    if (!bench_perf_warned) {
+        int e, any = 0;
+        for (e=0; e<BENCH_PERF_NUM_EVENTS; e++) {
+            bench_perf_available[e] = (bench_perf_fds[0][e] >= 0);
+            if (!bench_perf_available[e])
+                fprintf(stderr, "perf: %s not available on this machine\n", bench_perf_names[e]);
+            any |= bench_perf_available[e];
+        }
+        if (!any)
+            fprintf(stderr, "perf: perf_event_open failed (%s), check "
+                    "/proc/sys/kernel/perf_event_paranoid and that the CPU "
+                    "exposes a PMU\n", strerror(bench_perf_errno));
+        bench_perf_warned = 1;
+    }
+}
+
+static inline void bench_perf_ioctl(unsigned long request)
+{
+    int t, e;
+    for (t=0; t<BENCH_PERF_MAX_THREADS; t++) {
+        if (!bench_perf_opened[t])
+            continue;
+        for (e=0; e<BENCH_PERF_NUM_EVENTS; e++) {
+            int fd = bench_perf_fds[t][e];
+            if (fd >= 0)
+                ioctl(fd, request, 0);
+        }
+    }
+}
+
+static inline void bench_perf_start(void)
+{
+    if (!bench_perf_enabled)
+        return;
+    bench_perf_attach();
+    bench_perf_ioctl(PERF_EVENT_IOC_RESET);
+    bench_perf_ioctl(PERF_EVENT_IOC_ENABLE);
+}
+
+/* stop counting and store the totals over all threads in counts[];
+   counts are scaled up if the kernel had to multiplex the counters */
+static inline void bench_perf_stop(double *counts)
+{
+    int t, e;
+    for (e=0; e<BENCH_PERF_NUM_EVENTS; e++)
+        counts[e] = 0.0;
+    if (!bench_perf_enabled)
+        return;
+
+    bench_perf_ioctl(PERF_EVENT_IOC_DISABLE);
+
+    for (t=0; t<BENCH_PERF_MAX_THREADS; t++) {
+        if (!bench_perf_opened[t])
+            continue;
+        for (e=0; e<BENCH_PERF_NUM_EVENTS; e++) {
+            int fd = bench_perf_fds[t][e];
+            unsigned long long buf[3];
+            if (fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf))
+                continue;
+            double value = (double) buf[0];
+            if (buf[2] > 0 && buf[2] < buf[1])
+                value *= (double) buf[1] / (double) buf[2];
+            counts[e] += value;
+        }
+    }
+}
+
+#endif
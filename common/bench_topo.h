@@ -0,0 +1,285 @@
+/* Thread placement for the OpenMP benchmarks.
+ *
+ * omp_set_num_threads() says how many threads run but not where, so
+ * threads wander between cores and sockets and the scaling numbers move
+ * from run to run.  This header reads the CPU topology from
+ * /sys/devices/system/cpu (restricted to the CPUs we are allowed to run
+ * on, so taskset and cgroups still work) and pins OpenMP thread i to the
+ * i-th CPU of a placement order:
+ *
+ *   --bind=none      leave placement to the OS / OMP_PROC_BIND (default)
+ *   --bind=compact   fill a core's SMT siblings, then the next core, then
+ *                    the next package
+ *   --bind=scatter   round-robin over packages, then over cores, SMT
+ *                    siblings only once every core has a thread
+ *   --bind=core      one thread per physical core, SMT siblings skipped
+ *
+ * What --bind covers:
+ *
+ *  - the default team (omp_get_max_threads() threads): bench_start() calls
+ *    bench_topo_bind() outside the timed region, which pins every thread
+ *    of a team of that size with sched_setaffinity().  libgomp keeps the
+ *    same worker threads for later regions of the same size, so the
+ *    benchmarks' own parallel / parallel for regions run pinned.  The
+ *    region is only opened again when omp_get_max_threads() changes, not
+ *    on every repetition.
+ *  - regions that call bench_topo_pin() first thing: teams with their own
+ *    num_threads(...) (the loaders in stockwell_hw1_latency_bench.c,
+ *    NAME_init in padded_per_thread.h) and the task team of the mergesort
+ *    in flt_val_sort.c.  Slot i of the placement order goes to thread i of
+ *    whichever team calls it.
+ *  - not covered: nested teams (their thread numbers restart at 0, so they
+ *    would pile onto the outer team's first CPUs) and runtimes that don't
+ *    reuse threads between regions; use OMP_PLACES/OMP_PROC_BIND there.
+ *
+ * The topology is read when the flag is parsed, so bench_topo_pin() works
+ * in any region after bench_harness_args().  A thread that is already on
+ * its CPU skips the system call.  The mapping is printed on stderr the
+ * first time the default team is bound (and again if it grows).
+ */
+#ifndef BENCH_TOPO_H
+#define BENCH_TOPO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BENCH_TOPO_MAX_CPUS 1024
+#define BENCH_TOPO_MASK_WORDS (BENCH_TOPO_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+enum {
+    BENCH_BIND_NONE,
+    BENCH_BIND_COMPACT,
+    BENCH_BIND_SCATTER,
+    BENCH_BIND_CORE,
+    BENCH_BIND_NUM_POLICIES
+};
+
+static const char *bench_bind_names[BENCH_BIND_NUM_POLICIES] = {
+    "none", "compact", "scatter", "core"
+};
+
+static int bench_bind_policy = BENCH_BIND_NONE;
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;       /* core_id as reported by the kernel */
+    int core_rank;  /* index of the core within its package */
+    int smt;        /* index of the CPU among its core's siblings */
+} bench_cpu_t;
+
+static bench_cpu_t bench_topo_cpus[BENCH_TOPO_MAX_CPUS];
+static int bench_topo_ncpus = 0;
+static int bench_topo_order[BENCH_TOPO_MAX_CPUS];
+static int bench_topo_norder = 0;
+static int bench_topo_map[BENCH_TOPO_MAX_CPUS];
+static int bench_topo_reported = 0;
+static int bench_topo_bound = 0;   /* team size bench_topo_bind() last pinned */
+static __thread int bench_topo_pinned = -1;
+
+/* Parse --bind=<policy>; returns 0 if a is not a --bind flag.  Exits on an
+   unknown policy. */
+static inline int bench_topo_flag(const char *a)
+{
+    if (strncmp(a, "--bind=", 7) != 0)
+        return 0;
+    int p;
+    for (p=0; p<BENCH_BIND_NUM_POLICIES; p++) {
+        if (strcmp(a + 7, bench_bind_names[p]) == 0) {
+            bench_bind_policy = p;
+            return 1;
+        }
+    }
+    fprintf(stderr, "unknown binding %s, use none, compact, scatter or core\n", a + 7);
+    exit(1);
+}
+
+/* one integer from /sys/devices/system/cpu/cpu<cpu>/topology/<name>,
+   -1 if the CPU is offline or the file is missing */
+static inline int bench_topo_read(int cpu, const char *name)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    int value = -1;
+    if (fscanf(f, "%d", &value) != 1)
+        value = -1;
+    fclose(f);
+    return value;
+}
+
+static inline int bench_topo_cmp(const void *u, const void *v)
+{
+    const bench_cpu_t *a = &bench_topo_cpus[*(const int *) u];
+    const bench_cpu_t *b = &bench_topo_cpus[*(const int *) v];
+    int ka[3], kb[3], i;
+    if (bench_bind_policy == BENCH_BIND_SCATTER) {
+        ka[0] = a->smt; ka[1] = a->core_rank; ka[2] = a->package;
+        kb[0] = b->smt; kb[1] = b->core_rank; kb[2] = b->package;
+    } else {
+        ka[0] = a->package; ka[1] = a->core_rank; ka[2] = a->smt;
+        kb[0] = b->package; kb[1] = b->core_rank; kb[2] = b->smt;
+    }
+    for (i=0; i<3; i++) {
+        if (ka[i] != kb[i])
+            return (ka[i] > kb[i]) - (ka[i] < kb[i]);
+    }
+    return a->cpu - b->cpu;
+}
+
+/* read the topology of the CPUs in our affinity mask and build the
+   placement order for the selected policy */
+static inline void bench_topo_discover(void)
+{
+    unsigned long allowed[BENCH_TOPO_MASK_WORDS];
+    const int bits = 8 * sizeof(unsigned long);
+    int cpu, i;
+
+    memset(allowed, 0, sizeof(allowed));
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(allowed), allowed) < 0)
+        memset(allowed, 0xff, sizeof(allowed));
+
+    bench_topo_ncpus = 0;
+    for (cpu=0; cpu<BENCH_TOPO_MAX_CPUS; cpu++) {
+        if (!(allowed[cpu / bits] & (1UL << (cpu % bits))))
+            continue;
+        int core = bench_topo_read(cpu, "core_id");
+        int package = bench_topo_read(cpu, "physical_package_id");
+        if (core < 0)
+            continue;
+        bench_cpu_t *c = &bench_topo_cpus[bench_topo_ncpus++];
+        c->cpu = cpu;
+        c->package = (package < 0) ? 0 : package;
+        c->core = core;
+        c->smt = 0;
+        /* siblings and cores are numbered in the order the CPUs appear */
+        int sibling = -1, cores = 0;
+        for (i=0; i<bench_topo_ncpus-1; i++) {
+            bench_cpu_t *o = &bench_topo_cpus[i];
+            if (o->package != c->package)
+                continue;
+            if (o->core == c->core) {
+                c->smt++;
+                if (sibling < 0)
+                    sibling = i;
+            } else if (o->smt == 0) {
+                cores++;
+            }
+        }
+        c->core_rank = (sibling >= 0) ? bench_topo_cpus[sibling].core_rank : cores;
+    }
+
+    if (bench_topo_ncpus == 0) {
+        fprintf(stderr, "bind: no CPU topology in /sys/devices/system/cpu, not binding\n");
+        bench_bind_policy = BENCH_BIND_NONE;
+        return;
+    }
+
+    bench_topo_norder = 0;
+    for (i=0; i<bench_topo_ncpus; i++) {
+        if (bench_bind_policy == BENCH_BIND_CORE && bench_topo_cpus[i].smt != 0)
+            continue;
+        bench_topo_order[bench_topo_norder++] = i;
+    }
+    qsort(bench_topo_order, bench_topo_norder, sizeof(int), bench_topo_cmp);
+}
+
+/* pin the calling thread to slot tid of the placement order; call from
+   inside a parallel region with tid = omp_get_thread_num() */
+static inline void bench_topo_pin_slot(int tid)
+{
+    if (bench_bind_policy == BENCH_BIND_NONE || bench_topo_norder == 0)
+        return;
+
+    /* more threads than CPUs in the order: wrap around */
+    const bench_cpu_t *c = &bench_topo_cpus[bench_topo_order[tid % bench_topo_norder]];
+    if (tid < BENCH_TOPO_MAX_CPUS)
+        bench_topo_map[tid] = c->cpu;
+    if (bench_topo_pinned == c->cpu)
+        return;
+
+    unsigned long mask[BENCH_TOPO_MASK_WORDS];
+    const int bits = 8 * sizeof(unsigned long);
+    memset(mask, 0, sizeof(mask));
+    mask[c->cpu / bits] = 1UL << (c->cpu % bits);
+    /* pid 0 is the calling thread, not the whole process */
+    if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0)
+        bench_topo_pinned = c->cpu;
+}
+
+static inline void bench_topo_pin(void)
+{
+#ifdef _OPENMP
+    bench_topo_pin_slot(omp_get_thread_num());
+#else
+    bench_topo_pin_slot(0);
+#endif
+}
+
+static inline void bench_topo_report(int nthreads)
+{
+    int t;
+    fprintf(stderr, "Binding: %s, %d threads on %d of %d CPUs\n",
+            bench_bind_names[bench_bind_policy], nthreads,
+            nthreads < bench_topo_norder ? nthreads : bench_topo_norder,
+            bench_topo_ncpus);
+    if (nthreads > bench_topo_norder)
+        fprintf(stderr, "Binding: more threads than CPUs, threads share CPUs\n");
+    for (t=0; t<nthreads && t<BENCH_TOPO_MAX_CPUS; t++) {
+        const bench_cpu_t *c = &bench_topo_cpus[bench_topo_order[t % bench_topo_norder]];
+        fprintf(stderr, "  thread %3d -> cpu %3d (package %d, core %d, smt %d)\n",
+                t, bench_topo_map[t], c->package, c->core, c->smt);
+    }
+}
+
+/* read the topology once the policy is known; bench_harness_args() calls
+   this after parsing, before any region can call bench_topo_pin() */
+static inline void bench_topo_setup(void)
+{
+    if (bench_bind_policy != BENCH_BIND_NONE && bench_topo_ncpus == 0)
+        bench_topo_discover();
+}
+
+/* pin every thread of a default-sized team (omp_get_max_threads()) and
+   print the mapping when it grows; does nothing if that team size is
+   already pinned */
+static inline void bench_topo_bind(void)
+{
+    if (bench_bind_policy == BENCH_BIND_NONE)
+        return;
+    bench_topo_setup();
+    if (bench_bind_policy == BENCH_BIND_NONE)
+        return;
+
+    int nthreads = 1;
+#ifdef _OPENMP
+    if (omp_get_max_threads() == bench_topo_bound)
+        return;
+#pragma omp parallel
+    {
+        bench_topo_pin();
+#pragma omp single
+        nthreads = omp_get_num_threads();
+    }
+#else
+    if (bench_topo_bound == 1)
+        return;
+    bench_topo_pin();
+#endif
+    bench_topo_bound = nthreads;
+
+    if (nthreads > bench_topo_reported) {
+        bench_topo_report(nthreads);
+        bench_topo_reported = nthreads;
+    }
+}
+
+#endif
@@ -0,0 +1,189 @@
+/* Per-thread accumulators that don't false-share.
+ *
+ * Hand-padded arrays like part_sums[16*tid] assume 64-byte lines and
+ * 4-byte elements, and the whole array is first touched (so placed on a
+ * NUMA node) by whichever thread allocates it.  This header gives every
+ * thread its own slot:
+ *
+ *  - slots are aligned and padded to the cache line size read from the
+ *    system (sysconf, then sysfs, 64 if neither knows), or with
+ *    PPT_LINE_PAIR to two lines and at least 128 bytes, so the
+ *    adjacent-line prefetcher doesn't pull a neighbour's slot in either
+ *  - compiled with OpenMP, every slot is allocated and initialized by the
+ *    thread that owns it (inside a parallel region), so first touch puts
+ *    it on that thread's node.  Without OpenMP (e.g. pthreads callers)
+ *    the calling thread touches every slot, so the slots are padded but
+ *    all on its node
+ *
+ * PADDED_PER_THREAD_DEFINE(NAME, T, OP) defines the container NAME_t for
+ * elements of type T with:
+ *   NAME_init(p, count, init, flags)   count slots set to init; flags is
+ *                                      PPT_LINE or PPT_LINE_PAIR
+ *   NAME_local(p)                      the calling OpenMP thread's slot
+ *   NAME_slot(p, i)                    slot i, for threads numbered by hand
+ *                                      (e.g. pthreads)
+ *   NAME_combine(p)                    OP(...OP(slot 0, slot 1)..., slot
+ *                                      count-1), in slot order
+ *   NAME_destroy(p)
+ *
+ * Usage:
+ *   #include "../common/padded_per_thread.h"
+ *   ppt_int_t part_sums;
+ *   ppt_int_init(&part_sums, nthreads, 0, PPT_LINE);
+ *   #pragma omp parallel
+ *   { ... *ppt_int_local(&part_sums) += A[i]; ... }
+ *   int sum = ppt_int_combine(&part_sums);
+ *   ppt_int_destroy(&part_sums);
+ */
+#ifndef PADDED_PER_THREAD_H
+#define PADDED_PER_THREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "bench_topo.h"
+
+#define PPT_LINE      0   /* pad to one cache line */
+#define PPT_LINE_PAIR 1   /* pad to two lines, at least 128 bytes */
+
+#define PPT_DEFAULT_LINE 64
+
+#define PPT_ADD(a, b) ((a) + (b))
+
+/* the first-touch region in NAME_init, nothing without OpenMP */
+#ifdef _OPENMP
+#define PPT_PARALLEL_(count) _Pragma("omp parallel num_threads(count)")
+#else
+#define PPT_PARALLEL_(count)
+#endif
+
+/* L1 data cache line size in bytes */
+static inline size_t ppt_line_size(void)
+{
+    static size_t line = 0;
+    if (line != 0)
+        return line;
+
+    long l = -1;
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+    l = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+    if (l <= 0) {
+        FILE *f = fopen("/sys/devices/system/cpu/cpu0/cache/index0/coherency_line_size", "r");
+        if (f != NULL) {
+            if (fscanf(f, "%ld", &l) != 1)
+                l = -1;
+            fclose(f);
+        }
+    }
+    /* only a power of two is a usable alignment */
+    if (l <= 0 || (l & (l - 1)) != 0)
+        l = PPT_DEFAULT_LINE;
+    line = (size_t) l;
+    return line;
+}
+
+static inline size_t ppt_align(int flags)
+{
+    size_t align = ppt_line_size();
+    if (flags == PPT_LINE_PAIR) {
+        align *= 2;
+        if (align < 128)
+            align = 128;
+    }
+    return align;
+}
+
+static inline void ppt_team(int *tid, int *nthreads)
+{
+#ifdef _OPENMP
+    *tid = omp_get_thread_num();
+    *nthreads = omp_get_num_threads();
+#else
+    *tid = 0;
+    *nthreads = 1;
+#endif
+}
+
+static inline void *ppt_alloc_slot(size_t align, size_t size)
+{
+    void *slot = NULL;
+    if (posix_memalign(&slot, align, (size + align - 1) / align * align) != 0) {
+        fprintf(stderr, "padded_per_thread: out of memory\n");
+        exit(1);
+    }
+    return slot;
+}
+
+#define PADDED_PER_THREAD_DEFINE(NAME, T, OP) \
+\
+typedef struct { \
+    T **slots; \
+    int count; \
+} NAME##_t; \
+\
+static inline void NAME##_init(NAME##_t *p, int count, T init, int flags) \
+{ \
+    size_t align = ppt_align(flags); \
+    p->count = count; \
+    p->slots = (T **) calloc(count, sizeof(T *)); \
+    if (p->slots == NULL) { \
+        fprintf(stderr, "padded_per_thread: out of memory\n"); \
+        exit(1); \
+    } \
+\
+    /* slot i is allocated and first touched by thread i of a team of \
+       count, the same thread that owns it in a later parallel region \
+       of count threads with the same binding */ \
+    PPT_PARALLEL_(count) \
+    { \
+        int tid, nthreads, i; \
+        bench_topo_pin(); \
+        ppt_team(&tid, &nthreads); \
+        for (i=tid; i<count; i+=nthreads) { \
+            T *slot = (T *) ppt_alloc_slot(align, sizeof(T)); \
+            *slot = init; \
+            p->slots[i] = slot; \
+        } \
+    } \
+} \
+\
+static inline T *NAME##_slot(NAME##_t *p, int i) \
+{ \
+    return p->slots[i]; \
+} \
+\
+static inline T *NAME##_local(NAME##_t *p) \
+{ \
+    int tid, nthreads; \
+    ppt_team(&tid, &nthreads); \
+    return p->slots[tid]; \
+} \
+\
+static inline T NAME##_combine(NAME##_t *p) \
+{ \
+    T result = *p->slots[0]; \
+    int i; \
+    for (i=1; i<p->count; i++) \
+        result = OP(result, *p->slots[i]); \
+    return result; \
+} \
+\
+static inline void NAME##_destroy(NAME##_t *p) \
+{ \
+    int i; \
+    for (i=0; i<p->count; i++) \
+        free(p->slots[i]); \
+    free(p->slots); \
+    p->slots = NULL; \
+    p->count = 0; \
+}
+
+PADDED_PER_THREAD_DEFINE(ppt_int, int, PPT_ADD)
+PADDED_PER_THREAD_DEFINE(ppt_long, long, PPT_ADD)
+PADDED_PER_THREAD_DEFINE(ppt_double, double, PPT_ADD)
+
+#endif
@@ -0,0 +1,246 @@
+/* Parallel reductions over arrays.
+ *
+ * Replaces hand-written reduction(op:var) loops.  A reduction(*:total) into
+ * an int (hw1_exponent.c) overflows after a few dozen factors, and a
+ * reduction clause gives every thread a single accumulator, so each
+ * iteration waits for the previous add or multiply to finish.  Here:
+ *
+ *  - every thread reduces a contiguous block into PREDUCE_LANES independent
+ *    accumulators, updated by an omp simd loop: the lanes are the SIMD
+ *    lanes, and more lanes than one vector holds means several independent
+ *    dependency chains in flight
+ *  - the accumulator type can be wider than the element type (int summed
+ *    into int64_t), so the result doesn't overflow
+ *  - the lanes and then the per-thread partials (one cache line each) are
+ *    combined by a fixed pairwise tree, so a given thread count always
+ *    gives the same result, floating point included
+ *
+ * PARALLEL_REDUCE_DEFINE(NAME, T, ACC, IDENTITY, OP)
+ *   defines ACC NAME(const T *a, long n), the reduction of a[0..n) with
+ *   OP(acc, x), a macro or inline function, starting from IDENTITY.
+ * PARALLEL_ARGREDUCE_DEFINE(NAME, T, BETTER)
+ *   defines long NAME(const T *a, long n), the index of the element no
+ *   other element is BETTER(x, y) than (the first one on ties), -1 if n is 0.
+ *
+ * Operators: PREDUCE_ADD, PREDUCE_MUL (wraps modulo 2^64 for uint64_t),
+ * PREDUCE_MIN, PREDUCE_MAX, PREDUCE_MULMOD(a, b, m) for products modulo m
+ * (wrap it in a two-argument macro to instantiate), PREDUCE_LESS and
+ * PREDUCE_GREATER for the arg-reductions.
+ *
+ * Usage:
+ *   #include "../common/parallel_reduce.h"
+ *   int64_t sum = preduce_sum_i32(A, n);
+ *   #define mulmod_p(a, b) PREDUCE_MULMOD(a, b, 1000000007)
+ *   PARALLEL_REDUCE_DEFINE(prod_mod_p, int, uint64_t, 1, mulmod_p)
+ */
+#ifndef PARALLEL_REDUCE_H
+#define PARALLEL_REDUCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* accumulators per thread: two AVX-512 vectors of int64/double */
+#define PREDUCE_LANES 16
+
+/* one partial per cache line so the threads don't false-share */
+#define PREDUCE_PAD 64
+
+#define PREDUCE_ADD(a, b) ((a) + (b))
+#define PREDUCE_MUL(a, b) ((a) * (b))
+#define PREDUCE_MIN(a, b) (((b) < (a)) ? (b) : (a))
+#define PREDUCE_MAX(a, b) (((b) > (a)) ? (b) : (a))
+#define PREDUCE_MULMOD(a, b, m) ((uint64_t) (((unsigned __int128) (a) * (b)) % (m)))
+#define PREDUCE_LESS(a, b) ((a) < (b))
+#define PREDUCE_GREATER(a, b) ((a) > (b))
+
+static inline int preduce_max_threads(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static inline void preduce_team(int *tid, int *nthreads)
+{
+#ifdef _OPENMP
+    *tid = omp_get_thread_num();
+    *nthreads = omp_get_num_threads();
+#else
+    *tid = 0;
+    *nthreads = 1;
+#endif
+}
+
+/* start of thread tid's block, a multiple of PREDUCE_LANES */
+static inline long preduce_split(long n, int tid, int nthreads)
+{
+    if (tid == nthreads)
+        return n;
+    return (n / PREDUCE_LANES) * tid / nthreads * PREDUCE_LANES;
+}
+
+/* padded partials for slots threads, released with free() */
+static inline char *preduce_alloc(int slots, size_t size)
+{
+    void *p = NULL;
+    size_t pad = (size + PREDUCE_PAD - 1) / PREDUCE_PAD * PREDUCE_PAD;
+    if (posix_memalign(&p, PREDUCE_PAD, (size_t) slots * pad) != 0) {
+        fprintf(stderr, "parallel_reduce: out of memory\n");
+        exit(1);
+    }
+    return (char *) p;
+}
+
+#define PREDUCE_SLOT(TYPE, partials, slot) \
+    (*(TYPE *) ((partials) + (size_t) (slot) * ((sizeof(TYPE) + PREDUCE_PAD - 1) / PREDUCE_PAD * PREDUCE_PAD)))
+
+/* pairwise tree over ARR[0..COUNT), leaves the result in ARR[0] */
+#define PREDUCE_TREE_(ARR, COUNT, OP) do { \
+    int preduce_stride_, preduce_t_; \
+    for (preduce_stride_=1; preduce_stride_<(COUNT); preduce_stride_*=2) { \
+        for (preduce_t_=0; preduce_t_+preduce_stride_<(COUNT); preduce_t_+=2*preduce_stride_) \
+            (ARR)[preduce_t_] = OP((ARR)[preduce_t_], (ARR)[preduce_t_ + preduce_stride_]); \
+    } \
+} while (0)
+
+#define PARALLEL_REDUCE_DEFINE(NAME, T, ACC, IDENTITY, OP) \
+\
+static inline ACC NAME(const T *a, long n) \
+{ \
+    int max_threads = preduce_max_threads(); \
+    char *partials = preduce_alloc(max_threads, sizeof(ACC)); \
+    int team = 1; \
+\
+    _Pragma("omp parallel") \
+    { \
+        int tid, nthreads, l; \
+        preduce_team(&tid, &nthreads); \
+        if (tid == 0) \
+            team = nthreads; \
+        long lo = preduce_split(n, tid, nthreads); \
+        long hi = preduce_split(n, tid+1, nthreads); \
+        long i; \
+        ACC acc[PREDUCE_LANES]; \
+        for (l=0; l<PREDUCE_LANES; l++) \
+            acc[l] = (IDENTITY); \
+        for (i=lo; i+PREDUCE_LANES<=hi; i+=PREDUCE_LANES) { \
+            _Pragma("omp simd") \
+            for (l=0; l<PREDUCE_LANES; l++) \
+                acc[l] = OP(acc[l], (ACC) a[i+l]); \
+        } \
+        for (l=0; i<hi; i++, l++) \
+            acc[l] = OP(acc[l], (ACC) a[i]); \
+\
+        PREDUCE_TREE_(acc, PREDUCE_LANES, OP); \
+        PREDUCE_SLOT(ACC, partials, tid) = acc[0]; \
+    } \
+\
+    ACC totals[team]; \
+    int t; \
+    for (t=0; t<team; t++) \
+        totals[t] = PREDUCE_SLOT(ACC, partials, t); \
+    free(partials); \
+    PREDUCE_TREE_(totals, team, OP); \
+    return totals[0]; \
+}
+
+#define PARALLEL_ARGREDUCE_DEFINE(NAME, T, BETTER) \
+\
+typedef struct { \
+    T val; \
+    long idx;   /* -1: no element yet */ \
+} NAME##_arg_t; \
+\
+/* the better of two candidates, the lower index on ties */ \
+static inline NAME##_arg_t NAME##_pick_(NAME##_arg_t x, NAME##_arg_t y) \
+{ \
+    if (y.idx < 0) \
+        return x; \
+    if (x.idx < 0 || BETTER(y.val, x.val) || (!BETTER(x.val, y.val) && y.idx < x.idx)) \
+        return y; \
+    return x; \
+} \
+\
+static inline long NAME(const T *a, long n) \
+{ \
+    int max_threads = preduce_max_threads(); \
+    char *partials = preduce_alloc(max_threads, sizeof(NAME##_arg_t)); \
+    int team = 1; \
+\
+    _Pragma("omp parallel") \
+    { \
+        int tid, nthreads, l; \
+        preduce_team(&tid, &nthreads); \
+        if (tid == 0) \
+            team = nthreads; \
+        long lo = preduce_split(n, tid, nthreads); \
+        long hi = preduce_split(n, tid+1, nthreads); \
+        long i; \
+        T val[PREDUCE_LANES]; \
+        long idx[PREDUCE_LANES]; \
+        for (l=0; l<PREDUCE_LANES; l++) { \
+            val[l] = 0; \
+            idx[l] = -1; \
+        } \
+        /* the first full row of lanes seeds the candidates */ \
+        i = lo; \
+        if (i+PREDUCE_LANES <= hi) { \
+            for (l=0; l<PREDUCE_LANES; l++) { \
+                val[l] = a[i+l]; \
+                idx[l] = i+l; \
+            } \
+            i += PREDUCE_LANES; \
+        } \
+        for (; i+PREDUCE_LANES<=hi; i+=PREDUCE_LANES) { \
+            _Pragma("omp simd") \
+            for (l=0; l<PREDUCE_LANES; l++) { \
+                int take = BETTER(a[i+l], val[l]); \
+                val[l] = take ? a[i+l] : val[l]; \
+                idx[l] = take ? i+l : idx[l]; \
+            } \
+        } \
+        NAME##_arg_t best[PREDUCE_LANES]; \
+        for (l=0; l<PREDUCE_LANES; l++) { \
+            best[l].val = val[l]; \
+            best[l].idx = idx[l]; \
+        } \
+        for (l=0; i<hi; i++, l++) { \
+            NAME##_arg_t x = { a[i], i }; \
+            best[l] = NAME##_pick_(best[l], x); \
+        } \
+\
+        PREDUCE_TREE_(best, PREDUCE_LANES, NAME##_pick_); \
+        PREDUCE_SLOT(NAME##_arg_t, partials, tid) = best[0]; \
+    } \
+\
+    NAME##_arg_t totals[team]; \
+    int t; \
+    for (t=0; t<team; t++) \
+        totals[t] = PREDUCE_SLOT(NAME##_arg_t, partials, t); \
+    free(partials); \
+    PREDUCE_TREE_(totals, team, NAME##_pick_); \
+    return totals[0].idx; \
+}
+
+PARALLEL_REDUCE_DEFINE(preduce_sum_i32, int, int64_t, 0, PREDUCE_ADD)
+PARALLEL_REDUCE_DEFINE(preduce_sum_i64, int64_t, int64_t, 0, PREDUCE_ADD)
+PARALLEL_REDUCE_DEFINE(preduce_sum_f64, double, double, 0.0, PREDUCE_ADD)
+PARALLEL_REDUCE_DEFINE(preduce_prod_i32, int, uint64_t, 1, PREDUCE_MUL)
+PARALLEL_REDUCE_DEFINE(preduce_prod_f64, double, double, 1.0, PREDUCE_MUL)
+PARALLEL_REDUCE_DEFINE(preduce_min_i32, int, int, INT32_MAX, PREDUCE_MIN)
+PARALLEL_REDUCE_DEFINE(preduce_max_i32, int, int, INT32_MIN, PREDUCE_MAX)
+PARALLEL_REDUCE_DEFINE(preduce_min_f64, double, double, HUGE_VAL, PREDUCE_MIN)
+PARALLEL_REDUCE_DEFINE(preduce_max_f64, double, double, -HUGE_VAL, PREDUCE_MAX)
+PARALLEL_ARGREDUCE_DEFINE(preduce_argmin_i32, int, PREDUCE_LESS)
+PARALLEL_ARGREDUCE_DEFINE(preduce_argmax_i32, int, PREDUCE_GREATER)
+PARALLEL_ARGREDUCE_DEFINE(preduce_argmin_f64, double, PREDUCE_LESS)
+PARALLEL_ARGREDUCE_DEFINE(preduce_argmax_f64, double, PREDUCE_GREATER)
+
+#endif
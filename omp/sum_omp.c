@@ -6,40 +6,33 @@
 #ifdef _OPENMP
 #include <omp.h>
 #endif
-
-static double timer() {
-    /* 
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) (tp.tv_sec) + 1e-6 * tp.tv_usec);
-    */
-
-    /* The code below is for another high resolution timer */
-    /* I'm using gettimeofday because it's more portable */
-    
-    struct timespec tp;
-    clock_gettime(CLOCK_MONOTONIC, &tp);
-    return ((double) (tp.tv_sec) + 1e-9 * tp.tv_nsec);
-    
-}
+#include "../common/bench_alloc.h"
+#include "../common/bench_harness.h"
+#include "../common/parallel_reduce.h"
+#include "../common/padded_per_thread.h"
+#if defined(__x86_64__) || defined(__i386__)
+#define SUM_HAVE_X86 1
+#include <immintrin.h>
+#endif
 
 
 static int sum_serial(const int *A, const int n, const int num_iterations) {
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: serial\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_serial", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -49,8 +42,7 @@ static int sum_serial(const int *A, const int n, const int num_iterations) {
             sum += A[i];
         }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -58,10 +50,12 @@ static int sum_serial(const int *A, const int n, const int num_iterations) {
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 }
@@ -70,18 +64,19 @@ static int sum_parfor_reduce(const int *A, const int n, const int num_iterations
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel for and reduction clause\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parfor_reduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -91,8 +86,7 @@ static int sum_parfor_reduce(const int *A, const int n, const int num_iterations
             sum += A[i];
         }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -100,10 +94,12 @@ static int sum_parfor_reduce(const int *A, const int n, const int num_iterations
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 
@@ -113,18 +109,19 @@ static int sum_parregion_for_reduce(const int *A, const int n, const int num_ite
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel region, omp for, and reduction clause\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parregion_for_reduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -141,8 +138,7 @@ static int sum_parregion_for_reduce(const int *A, const int n, const int num_ite
         }
 }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -150,10 +146,12 @@ static int sum_parregion_for_reduce(const int *A, const int n, const int num_ite
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 
@@ -163,18 +161,19 @@ static int sum_parregion_for_myreduce(const int *A, const int n, const int num_i
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel region, omp for, and own reduction\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parregion_for_myreduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -196,8 +195,7 @@ static int sum_parregion_for_myreduce(const int *A, const int n, const int num_i
 
 }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -205,10 +203,12 @@ static int sum_parregion_for_myreduce(const int *A, const int n, const int num_i
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 
@@ -220,18 +220,19 @@ static int sum_parregion_myparfor_myreduce(const int *A, const int n, const int
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel region, own loop part, and own reduction\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parregion_myparfor_myreduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -277,8 +278,7 @@ static int sum_parregion_myparfor_myreduce(const int *A, const int n, const int
 
 }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -286,10 +286,12 @@ static int sum_parregion_myparfor_myreduce(const int *A, const int n, const int
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 }
@@ -299,18 +301,19 @@ static int sum_parfor_dynamicsched_reduce(const int *A, const int n, const int n
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel for (dynamic schedule) and reduction clause\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parfor_dynamicsched_reduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -320,8 +323,7 @@ static int sum_parfor_dynamicsched_reduce(const int *A, const int n, const int n
             sum += A[i];
         }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -329,10 +331,12 @@ static int sum_parfor_dynamicsched_reduce(const int *A, const int n, const int n
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 }
@@ -342,12 +346,13 @@ static int sum_parregion_for_falseshare_myreduce(const int *A, const int n, cons
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel region, for, and serial reduction with false sharing\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parregion_for_falseshare_myreduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
     int nthreads;
     int* part_sums;
@@ -366,11 +371,11 @@ static int sum_parregion_for_falseshare_myreduce(const int *A, const int n, cons
     part_sums = (int *) malloc(nthreads * sizeof(int));
     assert(part_sums != NULL);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -400,8 +405,7 @@ static int sum_parregion_for_falseshare_myreduce(const int *A, const int n, cons
         }
 }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -409,12 +413,14 @@ static int sum_parregion_for_falseshare_myreduce(const int *A, const int n, cons
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     free(part_sums);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 }
@@ -424,15 +430,16 @@ static int sum_parregion_for_nofalseshare_myreduce(const int *A, const int n, co
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel region, for, and serial reduction (without false sharing)\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parregion_for_nofalseshare_myreduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
     int nthreads;
-    int* part_sums;
+    ppt_int_t part_sums;
 
     /* Just a small parallel region to get number of threads */
 #pragma omp parallel
@@ -445,14 +452,15 @@ static int sum_parregion_for_nofalseshare_myreduce(const int *A, const int n, co
 #endif
 }
 
-    part_sums = (int *) malloc(nthreads * 16 * sizeof(int));
-    assert(part_sums != NULL);
+    /* one cache line per thread, whatever the line size (this used to be
+       part_sums[16*tid], which assumed 64-byte lines and 4-byte ints) */
+    ppt_int_init(&part_sums, nthreads, 0, PPT_LINE);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -467,23 +475,21 @@ static int sum_parregion_for_nofalseshare_myreduce(const int *A, const int n, co
         tid = 0;
 #endif
 
-        part_sums[16*tid] = 0;
+        int *part_sum = ppt_int_local(&part_sums);
+        *part_sum = 0;
 
 #pragma omp for private(i)
         for (i=0; i<n; i++) {
-            part_sums[16*tid] += A[i];
+            *part_sum += A[i];
         }
 
         /* let one thread do the summation now */
         if (tid == 0) {
-            for (i=0; i<nthreads; i++) {
-                sum += part_sums[16*i];
-            }
+            sum = ppt_int_combine(&part_sums);
         }
 }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* correctness check */
         assert(sum == (3*(n/2)));
@@ -491,12 +497,14 @@ static int sum_parregion_for_nofalseshare_myreduce(const int *A, const int n, co
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
-    free(part_sums);
+    ppt_int_destroy(&part_sums);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 
@@ -507,18 +515,19 @@ static int sum_parfor_sync_in_loop(const int *A, const int n, const int num_iter
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Variant: parallel for and sync inside loop\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parfor_sync_in_loop", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -530,18 +539,19 @@ static int sum_parfor_sync_in_loop(const int *A, const int n, const int num_iter
             sum += A[i];
         }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         assert(sum == (3*(n/2)));
         fprintf(stderr, "%9.3lf\n", elt*1e3);
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 
@@ -552,18 +562,19 @@ static int sum_parfor_sharedloopitervar(const int *A, const int n, const int num
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Parallel for, iteration variable is shared (compiler converts to local)\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "sum_parfor_sharedloopitervar", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -574,41 +585,215 @@ static int sum_parfor_sharedloopitervar(const int *A, const int n, const int num
             sum += A[i];
         }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         assert(sum == (3*(n/2)));
         fprintf(stderr, "%9.3lf\n", elt*1e3);
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 
 
 }
 
 
+static int sum_parallel_reduce(const int *A, const int n, const int num_iterations) {
+
+    fprintf(stderr, "N %d\n", n);
+    fprintf(stderr, "Variant: parallel_reduce (lanes of int64 accumulators, padded partials, tree combine)\n");
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
+
+    double avg_elt;
+
+    bench_t b;
+    bench_init(&b, "sum_parallel_reduce", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
+
+    while (bench_next(&b)) {
+
+        double elt;
+
+        bench_start(&b);
+
+        /* summed into int64_t, so no overflow for any n */
+        int64_t sum = preduce_sum_i32(A, n);
+
+        elt = bench_stop(&b);
+
+        assert(sum == (3*((int64_t) n/2)));
+        fprintf(stderr, "%9.3lf\n", elt*1e3);
+
+    }
+
+    avg_elt = bench_mean(&b);
+
+    fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
+    fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
+    return 0;
+
+}
+
+/* Widening vector kernels: every int is sign-extended into an int64 lane
+   (vpmovsxdq straight from memory), so the sum is exact for any n, and
+   several vector accumulators keep independent add chains in flight.
+   Compiled with #pragma GCC target, so the file builds without -mavx2;
+   main() only runs the ones the CPU supports. */
+
+typedef int64_t (*sum_kernel_t)(const int *A, long lo, long hi);
+
+#ifdef SUM_HAVE_X86
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+/* 4 accumulators x 4 int64 lanes, 16 ints per iteration */
+static int64_t sum_kernel_avx2(const int *A, long lo, long hi) {
+
+    __m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+    long i = lo;
+    for (; i+16<=hi; i+=16) {
+        a0 = _mm256_add_epi64(a0, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) (A+i))));
+        a1 = _mm256_add_epi64(a1, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) (A+i+4))));
+        a2 = _mm256_add_epi64(a2, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) (A+i+8))));
+        a3 = _mm256_add_epi64(a3, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) (A+i+12))));
+    }
+    a0 = _mm256_add_epi64(_mm256_add_epi64(a0, a1), _mm256_add_epi64(a2, a3));
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, a0);
+    int64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i<hi; i++) {
+        sum += A[i];
+    }
+    return sum;
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+/* 8 accumulators x 8 int64 lanes, 64 ints per iteration */
+static int64_t sum_kernel_avx512(const int *A, long lo, long hi) {
+
+    __m512i acc[8];
+    int k;
+    for (k=0; k<8; k++) {
+        acc[k] = _mm512_setzero_si512();
+    }
+    long i = lo;
+    for (; i+64<=hi; i+=64) {
+        for (k=0; k<8; k++) {
+            __m256i x = _mm256_loadu_si256((const __m256i *) (A+i+8*k));
+            acc[k] = _mm512_add_epi64(acc[k], _mm512_cvtepi32_epi64(x));
+        }
+    }
+    for (k=1; k<8; k++) {
+        acc[0] = _mm512_add_epi64(acc[0], acc[k]);
+    }
+
+    int64_t sum = _mm512_reduce_add_epi64(acc[0]);
+    for (; i<hi; i++) {
+        sum += A[i];
+    }
+    return sum;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+static int sum_parregion_widen(const int *A, const int n, const int num_iterations,
+                               const char *name, sum_kernel_t kernel) {
+
+    fprintf(stderr, "N %d\n", n);
+    fprintf(stderr, "Variant: parallel region, own loop part, %s widening kernel\n", name);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
+
+    double avg_elt;
+
+    char bench_name[64];
+    snprintf(bench_name, sizeof(bench_name), "sum_parregion_%s_widen", name);
+
+    bench_t b;
+    bench_init(&b, bench_name, num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
+
+    while (bench_next(&b)) {
+
+        double elt;
+
+        bench_start(&b);
+
+        int64_t sum = 0;
+
+#pragma omp parallel reduction(+:sum)
+{
+        int tid, nthreads;
+
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        nthreads = omp_get_num_threads();
+#else
+        tid = 0;
+        nthreads = 1;
+#endif
+
+        /* block boundaries on 64-byte lines, so only the last thread has a tail */
+        long lines = n/16;
+        long my_start_i = lines*tid/nthreads*16;
+        long my_end_i   = lines*(tid+1)/nthreads*16;
+
+        if (tid == (nthreads-1))
+            my_end_i = n;
+
+        sum += kernel(A, my_start_i, my_end_i);
+}
+
+        elt = bench_stop(&b);
+
+        assert(sum == (3*((int64_t) n/2)));
+        fprintf(stderr, "%9.3lf\n", elt*1e3);
+
+    }
+
+    avg_elt = bench_mean(&b);
+
+    fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
+    fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
+    return 0;
+
+}
+
 
 static int incorrect_sum_parfor_nosync(const int *A, const int n, const int num_iterations) {
 
     fprintf(stderr, "N %d\n", n);
     fprintf(stderr, "Buggy code: parallel for, no attempt to reduce\n");
-    fprintf(stderr, "Execution times (ms) for %d iterations:\n", num_iterations);
+    fprintf(stderr, "Execution times (ms), at least %d iterations:\n", num_iterations);
 
-    int iter;
     double avg_elt;
 
-    avg_elt = 0.0;
+    bench_t b;
+    bench_init(&b, "incorrect_sum_parfor_nosync", num_iterations);
+    bench_set_work(&b, 4.0*n, (double) n);
 
-    for (iter = 0; iter < num_iterations; iter++) {
+    while (bench_next(&b)) {
 
         double elt;
 
-        elt = timer();
+        bench_start(&b);
 
         int sum = 0;
 
@@ -618,8 +803,7 @@ static int incorrect_sum_parfor_nosync(const int *A, const int n, const int num_
             sum += A[i];
         }
 
-        elt = timer() - elt;
-        avg_elt += elt;
+        elt = bench_stop(&b);
 
         /* The assert is going to fail, so I'm commenting it out */
         // assert(sum == (3*(n/2)));
@@ -628,19 +812,24 @@ static int incorrect_sum_parfor_nosync(const int *A, const int n, const int num_
 
     }
 
-    avg_elt = avg_elt/num_iterations;
+    avg_elt = bench_mean(&b);
 
     fprintf(stderr, "Average time: %9.3lf ms.\n", avg_elt*1e3);
     fprintf(stderr, "Average read bandwidth: %6.3lf MB/s\n", 4.0*n/(avg_elt*1e6));
+    bench_report(&b);
+    bench_destroy(&b);
     return 0;
 }
     
 
 int main(int argc, char **argv) {
 
+    bench_alloc_args(&argc, argv);
+    bench_harness_args(&argc, argv);
+
     /* One input argument, value of n */
     if (argc != 2) {
-        fprintf(stderr, "%s <n>\n", argv[0]);
+        fprintf(stderr, "%s <n> [--alloc=<policy>] [harness flags, see common/bench_harness.h]\n", argv[0]);
         exit(1);
     }
 
@@ -654,7 +843,7 @@ int main(int argc, char **argv) {
     n = (n/4) * 4;
 
     int *A;
-    A = (int *) malloc(n * sizeof(int));
+    A = (int *) bench_alloc(n * sizeof(int));
     assert(A != 0);
 
     int i;
@@ -691,10 +880,24 @@ int main(int argc, char **argv) {
     sum_parfor_sync_in_loop(A, n, 1);
     
     sum_parfor_sharedloopitervar(A, n, num_iterations);
+
+    sum_parallel_reduce(A, n, num_iterations);
+
+#ifdef SUM_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        sum_parregion_widen(A, n, num_iterations, "avx2", sum_kernel_avx2);
+    else
+        fprintf(stderr, "Skipping the avx2 widening kernel, not supported by this CPU\n");
+    if (__builtin_cpu_supports("avx512f"))
+        sum_parregion_widen(A, n, num_iterations, "avx512", sum_kernel_avx512);
+    else
+        fprintf(stderr, "Skipping the avx512 widening kernel, not supported by this CPU\n");
+#endif
     
     incorrect_sum_parfor_nosync(A, n, num_iterations);
 
-    free(A);
+    bench_free(A);
 
     return 0;
 }